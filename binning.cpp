@@ -0,0 +1,254 @@
+#include "plugin.h"
+#include <windows.h>
+
+// SSE2 intrinsics are available for x86 and x64, their use is checked at runtime
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#   define HAVE_SSE2
+#   include <emmintrin.h>
+#endif
+
+using namespace Gatan;
+
+namespace {
+
+// Adds sums of bins of contiguous elements to count accumulators.
+template <typename T, typename A>
+void bin_row_scalar(const T* src, hsize_t count, hsize_t bin, A* dst)
+{
+    if (bin == 1) {
+        for (hsize_t n = 0; n < count; ++n)
+            dst[n] += A(src[n]);
+    } else {
+        for (hsize_t n = 0; n < count; ++n) {
+            A sum = 0;
+            const T* elements = src + n * bin;
+            for (hsize_t k = 0; k < bin; ++k)
+                sum += A(elements[k]);
+            dst[n] += sum;
+        }
+    }
+}
+
+template <typename T, typename A>
+inline void bin_row(const T* src, hsize_t count, hsize_t bin, A* dst)
+{
+    bin_row_scalar(src, count, bin, dst);
+}
+
+#ifdef HAVE_SSE2
+bool sse2_available()
+{
+    static const bool available = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) != 0;
+    return available;
+}
+
+inline void add_u64x2(unsigned long long* dst, const __m128i& value)
+{
+    __m128i* p = reinterpret_cast<__m128i*>(dst);
+    _mm_storeu_si128(p, _mm_add_epi64(_mm_loadu_si128(p), value));
+}
+
+// Adds the sums of bins of 8 unsigned 16 bit elements to 8 / bin accumulators, bin is 1, 2, 4, or 8.
+inline void add_bins_u16x8(const __m128i& v, hsize_t bin, unsigned long long* dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    if (bin == 1) {
+        __m128i lo = _mm_unpacklo_epi16(v, zero), hi = _mm_unpackhi_epi16(v, zero);
+        add_u64x2(dst, _mm_unpacklo_epi32(lo, zero));
+        add_u64x2(dst + 2, _mm_unpackhi_epi32(lo, zero));
+        add_u64x2(dst + 4, _mm_unpacklo_epi32(hi, zero));
+        add_u64x2(dst + 6, _mm_unpackhi_epi32(hi, zero));
+        return;
+    }
+
+    // Sums of pairs as 32 bit
+    __m128i sums = _mm_add_epi32(_mm_and_si128(v, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(v, 16));
+    if (bin == 2) {
+        add_u64x2(dst, _mm_unpacklo_epi32(sums, zero));
+        add_u64x2(dst + 2, _mm_unpackhi_epi32(sums, zero));
+        return;
+    }
+
+    // Sums of 4 elements as 64 bit
+    sums = _mm_add_epi64(_mm_and_si128(sums, _mm_set_epi32(0, -1, 0, -1)), _mm_srli_epi64(sums, 32));
+    if (bin == 4) {
+        add_u64x2(dst, sums);
+        return;
+    }
+
+    unsigned long long total[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(total), _mm_add_epi64(sums, _mm_srli_si128(sums, 8)));
+    dst[0] += total[0];
+}
+
+inline bool sse2_bin(hsize_t bin)
+{
+    return (bin == 1 || bin == 2 || bin == 4 || bin == 8) && sse2_available();
+}
+
+// Unsigned 8 and 16 bit detector data is the common case, summed 8 or 16 elements at once
+inline void bin_row(const unsigned short* src, hsize_t count, hsize_t bin, unsigned long long* dst)
+{
+    hsize_t n = 0;
+    if (sse2_bin(bin)) {
+        for (hsize_t step = 8 / bin; n + step <= count; n += step)
+            add_bins_u16x8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * bin)), bin, dst + n);
+    }
+    bin_row_scalar(src + n * bin, count - n, bin, dst + n);
+}
+
+inline void bin_row(const unsigned char* src, hsize_t count, hsize_t bin, unsigned long long* dst)
+{
+    hsize_t n = 0;
+    if (sse2_bin(bin)) {
+        const __m128i zero = _mm_setzero_si128();
+        for (hsize_t step = 16 / bin; n + step <= count; n += step) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * bin));
+            add_bins_u16x8(_mm_unpacklo_epi8(v, zero), bin, dst + n);
+            add_bins_u16x8(_mm_unpackhi_epi8(v, zero), bin, dst + n + step / 2);
+        }
+    }
+    bin_row_scalar(src + n * bin, count - n, bin, dst + n);
+}
+#endif
+
+/**
+ * Adds bins of input elements to accumulators.
+ * @param in Input elements with extent in_dims (HDF5 order).
+ * @param bins Elements per bin (HDF5 order).
+ * @param acc IN/OUT: Accumulators with extent in_dims / bins.
+ */
+template <typename T, typename A>
+void bin_block(const T* in, const hsize_t* in_dims, const hsize_t* bins, std::vector<A>& acc)
+{
+    hsize_t out_dims[4];
+    for (int n = 0; n < 4; ++n)
+        out_dims[n] = in_dims[n] / bins[n];
+
+    for (hsize_t i0 = 0; i0 < in_dims[0]; ++i0) {
+        hsize_t o0 = i0 / bins[0];
+        for (hsize_t i1 = 0; i1 < in_dims[1]; ++i1) {
+            hsize_t o1 = i1 / bins[1];
+            for (hsize_t i2 = 0; i2 < in_dims[2]; ++i2) {
+                hsize_t o2 = i2 / bins[2];
+                const T* src = in + ((i0 * in_dims[1] + i1) * in_dims[2] + i2) * in_dims[3];
+                A* dst = &acc[0] + ((o0 * out_dims[1] + o1) * out_dims[2] + o2) * out_dims[3];
+                bin_row(src, out_dims[3], bins[3], dst);
+            }
+        }
+    }
+}
+
+// Converts accumulators to output elements.
+template <typename A, typename O>
+void store_block(const std::vector<A>& acc, double divisor, O* out)
+{
+    if (divisor > 1) {
+        for (std::size_t n = 0; n < acc.size(); ++n)
+            out[n] = O(double(acc[n]) / divisor);
+    } else {
+        for (std::size_t n = 0; n < acc.size(); ++n)
+            out[n] = O(acc[n]);
+    }
+}
+
+template <typename A>
+bool store_acc(const std::vector<A>& acc, double divisor, long out_dtype, void* out)
+{
+    switch (out_dtype) {
+    case ImageData::SIGNED_INT32_DATA:   store_block(acc, divisor, static_cast<int*>(out)); return true;
+    case ImageData::UNSIGNED_INT32_DATA: store_block(acc, divisor, static_cast<unsigned int*>(out)); return true;
+    case ImageData::REAL4_DATA:          store_block(acc, divisor, static_cast<float*>(out)); return true;
+    case ImageData::REAL8_DATA:          store_block(acc, divisor, static_cast<double*>(out)); return true;
+    default:                             return false;
+    }
+}
+
+} // namespace
+
+long binned_datatype(long dtype, bool mean)
+{
+    switch (dtype) {
+    case ImageData::SIGNED_INT8_DATA:
+    case ImageData::SIGNED_INT16_DATA:
+        return mean ? ImageData::REAL4_DATA : ImageData::SIGNED_INT32_DATA;
+    case ImageData::UNSIGNED_INT8_DATA:
+    case ImageData::UNSIGNED_INT16_DATA:
+        return mean ? ImageData::REAL4_DATA : ImageData::UNSIGNED_INT32_DATA;
+    case ImageData::SIGNED_INT32_DATA:
+    case ImageData::UNSIGNED_INT32_DATA:
+    case undocumented_SIGNED_INT64_DATA:
+    case undocumented_UNSIGNED_INT64_DATA:
+        // Sums may exceed 32 bits
+        return mean ? ImageData::REAL4_DATA : ImageData::REAL8_DATA;
+    case ImageData::REAL4_DATA:
+        return ImageData::REAL4_DATA;
+    case ImageData::REAL8_DATA:
+        return ImageData::REAL8_DATA;
+    default:
+        return -1;
+    }
+}
+
+void reset_binning_acc(long dtype, std::size_t size, binning_acc_t& acc)
+{
+    acc.i.clear();
+    acc.u.clear();
+    acc.d.clear();
+    switch (dtype) {
+    case ImageData::SIGNED_INT8_DATA:
+    case ImageData::SIGNED_INT16_DATA:
+    case ImageData::SIGNED_INT32_DATA:
+    case undocumented_SIGNED_INT64_DATA:
+        acc.i.assign(size, 0);
+        break;
+    case ImageData::UNSIGNED_INT8_DATA:
+    case ImageData::UNSIGNED_INT16_DATA:
+    case ImageData::UNSIGNED_INT32_DATA:
+    case undocumented_UNSIGNED_INT64_DATA:
+        acc.u.assign(size, 0);
+        break;
+    case ImageData::REAL4_DATA:
+    case ImageData::REAL8_DATA:
+        acc.d.assign(size, 0.0);
+        break;
+    }
+}
+
+bool bin_elements(long dtype, const void* input, const hsize_t* in_dims, const hsize_t* bins, binning_acc_t& acc)
+{
+    switch (dtype) {
+    case ImageData::SIGNED_INT8_DATA:       bin_block(static_cast<const signed char*>(input), in_dims, bins, acc.i); return true;
+    case ImageData::SIGNED_INT16_DATA:      bin_block(static_cast<const short*>(input), in_dims, bins, acc.i); return true;
+    case ImageData::SIGNED_INT32_DATA:      bin_block(static_cast<const int*>(input), in_dims, bins, acc.i); return true;
+    case undocumented_SIGNED_INT64_DATA:    bin_block(static_cast<const long long*>(input), in_dims, bins, acc.i); return true;
+    case ImageData::UNSIGNED_INT8_DATA:     bin_block(static_cast<const unsigned char*>(input), in_dims, bins, acc.u); return true;
+    case ImageData::UNSIGNED_INT16_DATA:    bin_block(static_cast<const unsigned short*>(input), in_dims, bins, acc.u); return true;
+    case ImageData::UNSIGNED_INT32_DATA:    bin_block(static_cast<const unsigned int*>(input), in_dims, bins, acc.u); return true;
+    case undocumented_UNSIGNED_INT64_DATA:  bin_block(static_cast<const unsigned long long*>(input), in_dims, bins, acc.u); return true;
+    case ImageData::REAL4_DATA:             bin_block(static_cast<const float*>(input), in_dims, bins, acc.d); return true;
+    case ImageData::REAL8_DATA:             bin_block(static_cast<const double*>(input), in_dims, bins, acc.d); return true;
+    default:                                return false;
+    }
+}
+
+bool store_binned(long dtype, const binning_acc_t& acc, double divisor, long out_dtype, void* output)
+{
+    switch (dtype) {
+    case ImageData::SIGNED_INT8_DATA:
+    case ImageData::SIGNED_INT16_DATA:
+    case ImageData::SIGNED_INT32_DATA:
+    case undocumented_SIGNED_INT64_DATA:
+        return store_acc(acc.i, divisor, out_dtype, output);
+    case ImageData::UNSIGNED_INT8_DATA:
+    case ImageData::UNSIGNED_INT16_DATA:
+    case ImageData::UNSIGNED_INT32_DATA:
+    case undocumented_UNSIGNED_INT64_DATA:
+        return store_acc(acc.u, divisor, out_dtype, output);
+    case ImageData::REAL4_DATA:
+    case ImageData::REAL8_DATA:
+        return store_acc(acc.d, divisor, out_dtype, output);
+    default:
+        return false;
+    }
+}
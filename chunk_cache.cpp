@@ -0,0 +1,169 @@
+#include "plugin.h"
+#include <windows.h>
+#include <list>
+#include <map>
+
+using namespace Gatan;
+
+struct decoded_chunk_t
+{
+    std::string          path;      // Normalized file name
+    std::string          dataset;   // Key of dataset, see decoded_cache_key()
+    std::vector<hsize_t> offset;    // Element offset of chunk
+    std::vector<char>    data;      // Decompressed chunk
+};
+
+typedef std::list<decoded_chunk_t> decoded_list_t;
+typedef std::pair<std::string, std::vector<hsize_t> > decoded_key_t;
+
+// Most recently used chunks are at the front
+static decoded_list_t                                       decoded_chunks;
+static std::map<decoded_key_t, decoded_list_t::iterator>    decoded_index;
+static std::map<std::string, file_stamp_t>                  file_stamps;
+// 32 bit processes have little address space left besides DM's images
+static std::size_t   decoded_cache_capacity = (sizeof(void*) > 4 ? 256 : 32) * 1024 * 1024;
+static std::size_t   decoded_cache_bytes = 0;
+static unsigned long decoded_cache_hits = 0;
+static unsigned long decoded_cache_misses = 0;
+static unsigned long decoded_cache_evictions = 0;
+static unsigned long decoded_cache_invalidations = 0;
+
+bool get_file_stamp(const std::string& path, file_stamp_t& stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info))
+        return false;
+
+    stamp.size = ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    stamp.mtime = ((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+static void erase_chunk(decoded_list_t::iterator iter)
+{
+    decoded_index.erase(decoded_key_t(iter->dataset, iter->offset));
+    decoded_cache_bytes -= iter->data.size();
+    decoded_chunks.erase(iter);
+}
+
+// Removes least recently used chunks until the cache holds at most capacity bytes.
+static void trim_decoded_cache(std::size_t capacity)
+{
+    while (decoded_cache_bytes > capacity && !decoded_chunks.empty()) {
+        decoded_list_t::iterator iter = decoded_chunks.end();
+        erase_chunk(--iter);
+        ++decoded_cache_evictions;
+    }
+}
+
+std::string decoded_cache_key(hid_t dset_id)
+{
+    if (decoded_cache_capacity == 0)
+        return std::string();
+
+    file_handle_t file(H5Iget_file_id(dset_id));
+    ssize_t file_len = file.valid() ? H5Fget_name(file.get(), NULL, 0) : -1;
+    ssize_t name_len = H5Iget_name(dset_id, NULL, 0);
+    if (file_len <= 0 || name_len <= 0)
+        return std::string();
+
+    std::vector<char> filename(file_len + 1), name(name_len + 1);
+    if (H5Fget_name(file.get(), &filename[0], filename.size()) < 0 || H5Iget_name(dset_id, &name[0], name.size()) < 0)
+        return std::string();
+
+    // Chunks of a file changed by another program are outdated
+    std::string path = normalize_path(&filename[0]);
+    file_stamp_t stamp;
+    if (!get_file_stamp(path, stamp))
+        return std::string();
+    std::map<std::string, file_stamp_t>::iterator iter = file_stamps.find(path);
+    if (iter == file_stamps.end())
+        file_stamps.insert(std::make_pair(path, stamp));
+    else if (iter->second != stamp) {
+        invalidate_decoded_cache(path);
+        file_stamps[path] = stamp;
+    }
+
+    return path + '\n' + &name[0];
+}
+
+bool decoded_cache_find(const std::string& key, const std::vector<hsize_t>& offset, std::vector<char>& data)
+{
+    std::map<decoded_key_t, decoded_list_t::iterator>::const_iterator iter = decoded_index.find(decoded_key_t(key, offset));
+    if (iter == decoded_index.end()) {
+        ++decoded_cache_misses;
+        return false;
+    }
+
+    ++decoded_cache_hits;
+    decoded_chunks.splice(decoded_chunks.begin(), decoded_chunks, iter->second);
+    data = iter->second->data;
+    return true;
+}
+
+void decoded_cache_insert(const std::string& key, const std::vector<hsize_t>& offset, std::vector<char>& data)
+{
+    if (data.size() > decoded_cache_capacity / 4)
+        return;
+
+    std::map<decoded_key_t, decoded_list_t::iterator>::iterator iter = decoded_index.find(decoded_key_t(key, offset));
+    if (iter != decoded_index.end())
+        erase_chunk(iter->second);
+
+    trim_decoded_cache(decoded_cache_capacity - data.size());
+
+    decoded_chunks.push_front(decoded_chunk_t());
+    decoded_chunk_t& chunk = decoded_chunks.front();
+    chunk.path = key.substr(0, key.find('\n'));
+    chunk.dataset = key;
+    chunk.offset = offset;
+    chunk.data.swap(data);
+    decoded_cache_bytes += chunk.data.size();
+    decoded_index.insert(std::make_pair(decoded_key_t(key, offset), decoded_chunks.begin()));
+}
+
+bool decoded_cache_contains(const std::string& key, const std::vector<hsize_t>& offset)
+{
+    return decoded_index.find(decoded_key_t(key, offset)) != decoded_index.end();
+}
+
+unsigned long decoded_cache_generation()
+{
+    return decoded_cache_invalidations;
+}
+
+void invalidate_decoded_cache(const std::string& path)
+{
+    ++decoded_cache_invalidations;
+
+    decoded_list_t::iterator iter = decoded_chunks.begin();
+    while (iter != decoded_chunks.end())
+        if (_stricmp(iter->path.c_str(), path.c_str()) == 0)
+            erase_chunk(iter++);
+        else
+            ++iter;
+
+    // The plugin's own writes may not change the time stamp
+    file_stamps.erase(path);
+}
+
+std::size_t get_decoded_cache_size()
+{
+    return decoded_cache_capacity;
+}
+
+void set_decoded_cache_size(std::size_t size)
+{
+    ++decoded_cache_invalidations;
+    decoded_cache_capacity = size;
+    trim_decoded_cache(decoded_cache_capacity);
+}
+
+void decoded_cache_stats(DM::TagGroup& tags)
+{
+    tags.SetTagAsDouble("DecodedCacheBytes", double(decoded_cache_bytes));
+    tags.SetTagAsLong("DecodedCacheChunks", long(decoded_chunks.size()));
+    tags.SetTagAsUInt32("DecodedCacheHits", decoded_cache_hits);
+    tags.SetTagAsUInt32("DecodedCacheMisses", decoded_cache_misses);
+    tags.SetTagAsUInt32("DecodedCacheEvictions", decoded_cache_evictions);
+}
@@ -0,0 +1,986 @@
+#include "plugin.h"
+#include "threads.h"
+#include <zlib.h>
+#include <string.h>
+#include <process.h>
+#include <algorithm>
+#include <memory>
+#include <set>
+
+using namespace Gatan;
+
+// Direct chunk access was added in HDF5 1.10.3
+#if H5_VERSION_GE(1, 10, 3)
+#   define HAVE_DIRECT_CHUNK_WRITE
+#endif
+
+// Querying chunks by coordinate was added in HDF5 1.10.5
+#if H5_VERSION_GE(1, 10, 5)
+#   define HAVE_DIRECT_CHUNK_READ
+#endif
+
+// Number of worker threads, 0 for number of processors.
+static unsigned num_worker_threads = 0;
+
+// Worker threads shared by all parallel operations, created on first use. Guarded by the library lock.
+static worker_pool_t* worker_pool = NULL;
+
+struct chunk_filter_t
+{
+    H5Z_filter_t id;
+    unsigned     flags;
+    unsigned     level;     // Only deflate
+};
+
+struct compressed_chunk_t
+{
+    std::vector<char> data;
+    unsigned          filter_mask;
+};
+
+struct raw_chunk_t
+{
+    std::vector<hsize_t> offset;        // Element offset of chunk
+    std::vector<char>    data;          // Filtered data, empty if chunk is not allocated
+    unsigned             filter_mask;
+    bool                 decoded;       // data is decompressed
+    bool                 cached;        // data was found in decoded chunk cache
+
+    raw_chunk_t() : filter_mask(0), decoded(false), cached(false) {}
+};
+
+/**
+ * Geometry of a chunked dataset.
+ */
+struct chunk_layout_t
+{
+    int                  rank;
+    std::vector<hsize_t> dims;          // Extents of dataset (HDF5 order)
+    std::vector<hsize_t> chunk;         // Extents of chunk
+    std::vector<hsize_t> grid;          // Number of chunks per dimension
+    std::size_t          elemsize;
+    std::size_t          chunk_bytes;
+    hsize_t              num_chunks;
+
+    /** Returns element offset of chunk with linear index @p index (row major order). */
+    void offset(hsize_t index, hsize_t* offset) const
+    {
+        for (int n = rank - 1; n >= 0; --n) {
+            offset[n] = (index % grid[n]) * chunk[n];
+            index /= grid[n];
+        }
+    }
+
+    /** Returns extents of chunk at @p offset, which lie within the dataset. */
+    void extent(const hsize_t* offset, hsize_t* count) const
+    {
+        for (int n = 0; n < rank; ++n)
+            count[n] = std::min(chunk[n], dims[n] - offset[n]);
+    }
+};
+
+/**
+ * Reads layout of chunked dataset.
+ * @returns false if dataset is not chunked.
+ */
+static bool get_chunk_layout(hid_t dset_id, hid_t dcpl_id, std::size_t elemsize, chunk_layout_t& layout)
+{
+    if (H5Pget_layout(dcpl_id) != H5D_CHUNKED)
+        return false;
+
+    space_handle_t space(H5Dget_space(dset_id));
+    if (!space.valid())
+        return false;
+
+    layout.rank = hsize_array_from_HDF5(space.get(), layout.dims);
+    if (layout.rank <= 0)
+        return false;
+
+    layout.chunk.resize(layout.rank);
+    if (H5Pget_chunk(dcpl_id, layout.rank, &layout.chunk[0]) != layout.rank)
+        return false;
+
+    layout.elemsize = elemsize;
+    layout.chunk_bytes = elemsize;
+    layout.num_chunks = 1;
+    layout.grid.resize(layout.rank);
+    for (int n = 0; n < layout.rank; ++n) {
+        layout.grid[n] = (layout.dims[n] + layout.chunk[n] - 1) / layout.chunk[n];
+        layout.chunk_bytes *= std::size_t(layout.chunk[n]);
+        layout.num_chunks *= layout.grid[n];
+    }
+
+    return true;
+}
+
+/**
+ * Reads filter pipeline.
+ * @returns false, if the pipeline contains filters not supported by the plugin.
+ */
+static bool get_chunk_filters(hid_t dcpl_id, std::vector<chunk_filter_t>& filters)
+{
+    int nfilters = H5Pget_nfilters(dcpl_id);
+    if (nfilters < 0)
+        return false;
+
+    filters.resize(nfilters);
+    for (int n = 0; n < nfilters; ++n) {
+        unsigned cd_values[8];
+        size_t cd_nelmts = 8;
+        char name[64];
+        unsigned config;
+        chunk_filter_t& filter = filters[n];
+        filter.id = H5Pget_filter2(dcpl_id, unsigned(n), &filter.flags, &cd_nelmts, cd_values, sizeof(name), name, &config);
+        filter.level = 0;
+
+        switch (filter.id) {
+        case H5Z_FILTER_DEFLATE:
+            if (cd_nelmts < 1)
+                return false;
+            filter.level = cd_values[0];
+            break;
+
+        case H5Z_FILTER_SHUFFLE:
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Same as H5Z_filter_shuffle()
+static void shuffle(const char* src, char* dst, std::size_t nbytes, std::size_t elemsize)
+{
+    std::size_t nelems = nbytes / elemsize;
+    for (std::size_t i = 0; i < elemsize; ++i)
+        for (std::size_t j = 0; j < nelems; ++j)
+            dst[i * nelems + j] = src[j * elemsize + i];
+
+    std::size_t leftover = nbytes % elemsize;
+    memcpy(dst + nbytes - leftover, src + nbytes - leftover, leftover);
+}
+
+/**
+ * Applies filters to chunk (the same way as the HDF5 pipeline does).
+ * @param data IN/OUT: Chunk data.
+ * @param filter_mask OUT: Mask of skipped filters.
+ * @returns Whether succeeded.
+ */
+static bool apply_filters(const std::vector<chunk_filter_t>& filters, std::size_t elemsize, std::vector<char>& data, unsigned& filter_mask)
+{
+    filter_mask = 0;
+
+    std::vector<char> tmp;
+    for (std::size_t n = 0; n < filters.size(); ++n) {
+        switch (filters[n].id) {
+        case H5Z_FILTER_SHUFFLE:
+            if (elemsize <= 1 || data.size() <= elemsize)
+                continue;
+            tmp.resize(data.size());
+            shuffle(&data[0], &tmp[0], data.size(), elemsize);
+            break;
+
+        case H5Z_FILTER_DEFLATE:
+            {
+                uLongf nbytes = compressBound(uLong(data.size()));
+                tmp.resize(nbytes);
+                if (compress2(reinterpret_cast<Bytef*>(&tmp[0]), &nbytes, reinterpret_cast<const Bytef*>(&data[0]), uLong(data.size()), int(filters[n].level)) != Z_OK) {
+                    if (!(filters[n].flags & H5Z_FLAG_OPTIONAL))
+                        return false;
+                    filter_mask |= 1u << n;
+                    continue;
+                }
+                tmp.resize(nbytes);
+            }
+            break;
+
+        default:
+            return false;
+        }
+
+        data.swap(tmp);
+    }
+
+    return true;
+}
+
+// Reverts shuffle()
+static void unshuffle(const char* src, char* dst, std::size_t nbytes, std::size_t elemsize)
+{
+    std::size_t nelems = nbytes / elemsize;
+    for (std::size_t i = 0; i < elemsize; ++i)
+        for (std::size_t j = 0; j < nelems; ++j)
+            dst[j * elemsize + i] = src[i * nelems + j];
+
+    std::size_t leftover = nbytes % elemsize;
+    memcpy(dst + nbytes - leftover, src + nbytes - leftover, leftover);
+}
+
+/**
+ * Removes filters from chunk, i.e. applies the filter pipeline in reverse order.
+ * @param data IN/OUT: Chunk data.
+ * @param filter_mask Mask of filters skipped when the chunk was written.
+ * @returns Whether succeeded and the chunk has the expected size.
+ */
+static bool remove_filters(const std::vector<chunk_filter_t>& filters, std::size_t elemsize, std::size_t chunk_bytes, std::vector<char>& data, unsigned filter_mask)
+{
+    std::vector<char> tmp;
+    for (std::size_t n = filters.size(); n-- > 0; ) {
+        if (filter_mask & (1u << n))
+            continue;
+
+        switch (filters[n].id) {
+        case H5Z_FILTER_SHUFFLE:
+            if (elemsize <= 1 || data.size() <= elemsize)
+                continue;
+            tmp.resize(data.size());
+            unshuffle(&data[0], &tmp[0], data.size(), elemsize);
+            break;
+
+        case H5Z_FILTER_DEFLATE:
+            {
+                if (data.empty())
+                    return false;
+                uLongf nbytes = uLongf(chunk_bytes);
+                tmp.resize(chunk_bytes);
+                if (uncompress(reinterpret_cast<Bytef*>(&tmp[0]), &nbytes, reinterpret_cast<const Bytef*>(&data[0]), uLong(data.size())) != Z_OK)
+                    return false;
+                tmp.resize(nbytes);
+            }
+            break;
+
+        default:
+            return false;
+        }
+
+        data.swap(tmp);
+    }
+
+    return data.size() == chunk_bytes;
+}
+
+/**
+ * Copies a box of @p count elements from array @p src (extents @p src_dims) at @p src_offset
+ * to array @p dst (extents @p dst_dims) at @p dst_offset. All in HDF5 (row-major) order.
+ * If @p src_step is not NULL, it is the distance of the elements in @p src for each dimension.
+ */
+static void copy_box(int rank, std::size_t elemsize, const hsize_t* count,
+                     const char* src, const hsize_t* src_dims, const hsize_t* src_offset,
+                     char* dst, const hsize_t* dst_dims, const hsize_t* dst_offset,
+                     const hsize_t* src_step = NULL)
+{
+    // Strides in bytes
+    std::vector<hsize_t> src_stride(rank), dst_stride(rank);
+    hsize_t src_pos = 0, dst_pos = 0;
+    for (int n = rank - 1; n >= 0; --n) {
+        src_stride[n] = (n == rank - 1) ? elemsize : src_stride[n + 1] * src_dims[n + 1];
+        dst_stride[n] = (n == rank - 1) ? elemsize : dst_stride[n + 1] * dst_dims[n + 1];
+        src_pos += src_offset[n] * src_stride[n];
+        dst_pos += dst_offset[n] * dst_stride[n];
+    }
+    if (src_step) {
+        for (int n = 0; n < rank; ++n)
+            src_stride[n] *= src_step[n];
+    }
+
+    // Iterate over rows (last dimension is contiguous in dst)
+    std::size_t row_bytes = std::size_t(count[rank - 1]) * elemsize;
+    bool contiguous = src_stride[rank - 1] == elemsize;
+    std::vector<hsize_t> index(rank, 0);
+    for (;;) {
+        if (contiguous) {
+            memcpy(dst + dst_pos, src + src_pos, row_bytes);
+        } else {
+            const char* s = src + src_pos;
+            for (std::size_t pos = 0; pos < row_bytes; pos += elemsize, s += src_stride[rank - 1])
+                memcpy(dst + dst_pos + pos, s, elemsize);
+        }
+
+        int n = rank - 2;
+        while (n >= 0) {
+            src_pos += src_stride[n];
+            dst_pos += dst_stride[n];
+            if (++index[n] < count[n])
+                break;
+            src_pos -= count[n] * src_stride[n];
+            dst_pos -= count[n] * dst_stride[n];
+            index[n] = 0;
+            --n;
+        }
+        if (n < 0)
+            break;
+    }
+}
+
+/**
+ * Extracts and compresses a batch of chunks from the image buffer.
+ */
+struct compress_task_t : public worker_pool_t::task_t
+{
+    const chunk_layout_t&               layout;
+    const std::vector<chunk_filter_t>&  filters;
+    const char*                         buffer;
+    const std::vector<char>&            fill;       // Chunk filled with fill value
+    hsize_t                             first;      // Index of first chunk in batch
+    std::vector<compressed_chunk_t>*    batch;
+
+    compress_task_t(const chunk_layout_t& _layout, const std::vector<chunk_filter_t>& _filters, const char* _buffer, const std::vector<char>& _fill)
+    : layout(_layout), filters(_filters), buffer(_buffer), fill(_fill), first(0), batch(NULL)
+    {}
+
+    virtual bool run(std::size_t index)
+    {
+        std::vector<hsize_t> offset(layout.rank), count(layout.rank);
+        layout.offset(first + index, &offset[0]);
+        layout.extent(&offset[0], &count[0]);
+
+        // Partial chunks at the edges are padded with the fill value
+        compressed_chunk_t& out = (*batch)[index];
+        out.data = fill;
+
+        std::vector<hsize_t> zero(layout.rank, 0);
+        copy_box(layout.rank, layout.elemsize, &count[0],
+                 buffer, &layout.dims[0], &offset[0],
+                 &out.data[0], &layout.chunk[0], &zero[0]);
+
+        return apply_filters(filters, layout.elemsize, out.data, out.filter_mask);
+    }
+};
+
+/**
+ * Returns a chunk filled with the fill value of the dataset.
+ */
+static bool get_fill_chunk(hid_t dcpl_id, hid_t type_id, std::size_t elemsize, std::size_t chunk_bytes, std::vector<char>& fill)
+{
+    fill.assign(chunk_bytes, 0);
+
+    H5D_fill_time_t fill_time;
+    if (H5Pget_fill_time(dcpl_id, &fill_time) < 0)
+        return false;
+    if (fill_time == H5D_FILL_TIME_NEVER)
+        return true;
+
+    std::vector<char> value(elemsize);
+    if (H5Pget_fill_value(dcpl_id, type_id, &value[0]) < 0)
+        return false;
+
+    for (std::size_t pos = 0; pos + elemsize <= chunk_bytes; pos += elemsize)
+        memcpy(&fill[pos], &value[0], elemsize);
+
+    return true;
+}
+
+bool write_chunks_parallel(hid_t dset_id, hid_t memtype_id, const void* buffer)
+{
+#ifdef HAVE_DIRECT_CHUNK_WRITE
+    if (num_worker_threads == 1)
+        return false;
+
+    type_handle_t type(H5Dget_type(dset_id));
+    if (!type.valid() || H5Tequal(type.get(), memtype_id) <= 0)
+        return false;
+
+    plist_handle_t dcpl(H5Dget_create_plist(dset_id));
+    if (!dcpl.valid())
+        return false;
+
+    chunk_layout_t layout;
+    if (!get_chunk_layout(dset_id, dcpl.get(), H5Tget_size(type.get()), layout) || layout.num_chunks < 2)
+        return false;
+
+    // Only worthwhile with compression
+    std::vector<chunk_filter_t> filters;
+    if (!get_chunk_filters(dcpl.get(), filters))
+        return false;
+    bool compressed = false;
+    for (std::size_t n = 0; n < filters.size(); ++n)
+        compressed = compressed || filters[n].id == H5Z_FILTER_DEFLATE;
+    if (!compressed)
+        return false;
+
+    std::vector<char> fill;
+    if (!get_fill_chunk(dcpl.get(), type.get(), layout.elemsize, layout.chunk_bytes, fill))
+        return false;
+
+    worker_pool_t& pool = get_worker_pool();
+    if (pool.size() < 2)
+        return false;
+
+    // While one batch is written, the next is compressed
+    std::size_t batch_size = 4 * pool.size();
+    std::vector<compressed_chunk_t> batches[2];
+    compress_task_t task(layout, filters, static_cast<const char*>(buffer), fill);
+    worker_pool_t::job_t job;
+
+    hsize_t num_batches = (layout.num_chunks + batch_size - 1) / batch_size;
+    for (hsize_t b = 0; b <= num_batches; ++b) {
+        if (b > 0 && !pool.wait(job)) {
+            warning("write_chunks_parallel: Compression failed.");
+            return false;
+        }
+
+        if (b < num_batches) {
+            task.first = b * batch_size;
+            task.batch = &batches[b % 2];
+            task.batch->resize(std::size_t(std::min<hsize_t>(batch_size, layout.num_chunks - task.first)));
+            pool.start(job, task, task.batch->size());
+        }
+
+        if (b == 0)
+            continue;
+
+        // Write previous batch in order
+        const std::vector<compressed_chunk_t>& batch = batches[(b - 1) % 2];
+        hsize_t first = (b - 1) * batch_size;
+        std::vector<hsize_t> offset(layout.rank);
+        for (std::size_t n = 0; n < batch.size(); ++n) {
+            layout.offset(first + n, &offset[0]);
+            if (H5Dwrite_chunk(dset_id, H5P_DEFAULT, batch[n].filter_mask, &offset[0], batch[n].data.size(), &batch[n].data[0]) < 0) {
+                warning("write_chunks_parallel: Writing chunk failed.");
+                dump_HDF_error_stack();
+                pool.wait(job);
+                return false;
+            }
+        }
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Hyperslab selection in HDF5 order.
+ */
+struct chunk_selection_t
+{
+    std::vector<hsize_t> offset;
+    std::vector<hsize_t> stride;
+    std::vector<hsize_t> count;
+
+    /**
+     * Returns the part of the selection within the elements [@p start, @p end) of dimension @p n.
+     * @param first OUT: Index of first selected element in the selection.
+     * @returns Number of selected elements.
+     */
+    hsize_t intersect(int n, hsize_t start, hsize_t end, hsize_t& first) const
+    {
+        if (end <= offset[n])
+            return 0;
+        first = start > offset[n] ? (start - offset[n] + stride[n] - 1) / stride[n] : 0;
+        hsize_t last = std::min(count[n], (end - offset[n] + stride[n] - 1) / stride[n]);
+        return last > first ? last - first : 0;
+    }
+
+    /**
+     * Determines chunks intersecting the selection.
+     * @param hits OUT: Element offsets of the chunks per dimension.
+     * @returns Number of chunks, 0 if the selection is empty or exceeds the dataset.
+     */
+    hsize_t chunks(const chunk_layout_t& layout, std::vector<std::vector<hsize_t> >& hits) const
+    {
+        hits.assign(layout.rank, std::vector<hsize_t>());
+        hsize_t num_chunks = 1;
+        for (int n = 0; n < layout.rank; ++n) {
+            if (count[n] == 0 || stride[n] == 0)
+                return 0;
+            hsize_t last = offset[n] + (count[n] - 1) * stride[n];
+            if (last >= layout.dims[n])
+                return 0;
+
+            for (hsize_t c = offset[n] / layout.chunk[n]; c <= last / layout.chunk[n]; ++c) {
+                hsize_t first;
+                hsize_t start = c * layout.chunk[n];
+                if (intersect(n, start, std::min(start + layout.chunk[n], layout.dims[n]), first) > 0)
+                    hits[n].push_back(start);
+            }
+            num_chunks *= hits[n].size();
+        }
+        return num_chunks;
+    }
+};
+
+/**
+ * Decompresses a batch of chunks and scatters the selected elements into the buffer.
+ * The chunks of a batch don't overlap, so they are written concurrently.
+ */
+struct decompress_task_t : public worker_pool_t::task_t
+{
+    const chunk_layout_t&               layout;
+    const std::vector<chunk_filter_t>&  filters;
+    const chunk_selection_t&            selection;
+    char*                               buffer;
+    const std::vector<char>&            fill;       // Chunk filled with fill value
+    bool                                keep;       // Keep decompressed chunks for the cache
+    std::vector<raw_chunk_t>*           batch;
+
+    decompress_task_t(const chunk_layout_t& _layout, const std::vector<chunk_filter_t>& _filters, const chunk_selection_t& _selection, char* _buffer, const std::vector<char>& _fill, bool _keep)
+    : layout(_layout), filters(_filters), selection(_selection), buffer(_buffer), fill(_fill), keep(_keep), batch(NULL)
+    {}
+
+    virtual bool run(std::size_t index)
+    {
+        raw_chunk_t& in = (*batch)[index];
+
+        // Unallocated chunks contain the fill value
+        std::vector<char> chunk;
+        if (in.decoded) {
+            // Found in decoded chunk cache
+        } else if (in.data.empty()) {
+            chunk = fill;
+        } else {
+            chunk.swap(in.data);
+            if (!remove_filters(filters, layout.elemsize, layout.chunk_bytes, chunk, in.filter_mask))
+                return false;
+            if (keep) {
+                in.data.swap(chunk);
+                in.decoded = true;
+            }
+        }
+        const std::vector<char>& decoded = in.decoded ? in.data : chunk;
+
+        std::vector<hsize_t> src_offset(layout.rank), dst_offset(layout.rank), count(layout.rank);
+        for (int n = 0; n < layout.rank; ++n) {
+            hsize_t start = in.offset[n];
+            hsize_t end = std::min(start + layout.chunk[n], layout.dims[n]);
+            count[n] = selection.intersect(n, start, end, dst_offset[n]);
+            if (count[n] == 0)
+                return true;
+            src_offset[n] = selection.offset[n] + dst_offset[n] * selection.stride[n] - start;
+        }
+
+        copy_box(layout.rank, layout.elemsize, &count[0],
+                 &decoded[0], &layout.chunk[0], &src_offset[0],
+                 buffer, &selection.count[0], &dst_offset[0],
+                 &selection.stride[0]);
+        return true;
+    }
+};
+
+#ifdef HAVE_DIRECT_CHUNK_READ
+/**
+ * Reads filtered chunk from file.
+ */
+static bool read_raw_chunk(hid_t dset_id, raw_chunk_t& chunk)
+{
+    haddr_t addr;
+    hsize_t size = 0;
+    if (H5Dget_chunk_info_by_coord(dset_id, &chunk.offset[0], &chunk.filter_mask, &addr, &size) < 0)
+        return false;
+
+    if (addr == HADDR_UNDEF || size == 0) {
+        chunk.data.clear();
+        return true;
+    }
+
+    uint32_t filter_mask = 0;
+    chunk.data.resize(std::size_t(size));
+    if (H5Dread_chunk(dset_id, H5P_DEFAULT, &chunk.offset[0], &filter_mask, &chunk.data[0]) < 0)
+        return false;
+    chunk.filter_mask = filter_mask;
+    return true;
+}
+
+// Moves chunks decompressed by decompress_task_t into the decoded chunk cache.
+static void insert_decoded_chunks(const std::string& cache_key, std::vector<raw_chunk_t>& batch)
+{
+    for (std::vector<raw_chunk_t>::iterator iter = batch.begin(); iter != batch.end(); ++iter)
+        if (iter->decoded && !iter->cached)
+            decoded_cache_insert(cache_key, iter->offset, iter->data);
+}
+#endif
+
+bool read_chunks_parallel(hid_t dset_id, hid_t memtype_id, const hsize_t* offset, const hsize_t* stride, const hsize_t* count, void* buffer,
+                          bool cached)
+{
+#ifdef HAVE_DIRECT_CHUNK_READ
+    type_handle_t type(H5Dget_type(dset_id));
+    if (!type.valid() || H5Tequal(type.get(), memtype_id) <= 0)
+        return false;
+
+    plist_handle_t dcpl(H5Dget_create_plist(dset_id));
+    if (!dcpl.valid())
+        return false;
+
+    chunk_layout_t layout;
+    if (!get_chunk_layout(dset_id, dcpl.get(), H5Tget_size(type.get()), layout) || layout.num_chunks == 0)
+        return false;
+
+    std::vector<chunk_filter_t> filters;
+    if (!get_chunk_filters(dcpl.get(), filters))
+        return false;
+    bool compressed = false;
+    for (std::size_t n = 0; n < filters.size(); ++n)
+        compressed = compressed || filters[n].id == H5Z_FILTER_DEFLATE;
+
+    // Without cache, only worthwhile for several compressed chunks
+    std::string cache_key = cached ? decoded_cache_key(dset_id) : std::string();
+    bool use_cache = !cache_key.empty();
+    if (!use_cache && (!compressed || num_worker_threads == 1))
+        return false;
+
+    chunk_selection_t selection;
+    if (offset) {
+        selection.offset.assign(offset, offset + layout.rank);
+        selection.stride.assign(stride, stride + layout.rank);
+        selection.count.assign(count, count + layout.rank);
+    } else {
+        selection.offset.assign(layout.rank, 0);
+        selection.stride.assign(layout.rank, 1);
+        selection.count = layout.dims;
+    }
+
+    // Chunks intersecting the selection per dimension
+    std::vector<std::vector<hsize_t> > hits;
+    hsize_t num_chunks = selection.chunks(layout, hits);
+    if (num_chunks == 0 || (num_chunks < 2 && !use_cache))
+        return false;
+
+    std::vector<char> fill;
+    if (!get_fill_chunk(dcpl.get(), type.get(), layout.elemsize, layout.chunk_bytes, fill))
+        return false;
+
+    worker_pool_t& pool = get_worker_pool();
+    if (pool.size() < 2 && !use_cache)
+        return false;
+
+    // While one batch is decompressed, the next is read
+    std::size_t batch_size = 4 * std::max<std::size_t>(pool.size(), 1);
+    std::vector<raw_chunk_t> batches[2];
+    decompress_task_t task(layout, filters, selection, static_cast<char*>(buffer), fill, use_cache);
+    worker_pool_t::job_t job;
+
+    std::vector<std::size_t> index(layout.rank, 0);
+    hsize_t num_batches = (num_chunks + batch_size - 1) / batch_size;
+    for (hsize_t b = 0; b < num_batches; ++b) {
+        std::vector<raw_chunk_t>& batch = batches[b % 2];
+        batch.resize(std::size_t(std::min<hsize_t>(batch_size, num_chunks - b * batch_size)));
+        for (std::size_t k = 0; k < batch.size(); ++k) {
+            batch[k].offset.resize(layout.rank);
+            for (int n = 0; n < layout.rank; ++n)
+                batch[k].offset[n] = hits[n][index[n]];
+
+            // Next chunk in row-major order
+            for (int n = layout.rank - 1; n >= 0; --n) {
+                if (++index[n] < hits[n].size())
+                    break;
+                index[n] = 0;
+            }
+
+            batch[k].decoded = batch[k].cached = use_cache && decoded_cache_find(cache_key, batch[k].offset, batch[k].data);
+            if (!batch[k].cached && !read_raw_chunk(dset_id, batch[k])) {
+                warning("read_chunks_parallel: Reading chunk failed.");
+                dump_HDF_error_stack();
+                pool.wait(job);
+                return false;
+            }
+        }
+
+        if (b > 0) {
+            if (!pool.wait(job)) {
+                warning("read_chunks_parallel: Decompression failed.");
+                return false;
+            }
+            if (use_cache)
+                insert_decoded_chunks(cache_key, batches[(b - 1) % 2]);
+        }
+
+        task.batch = &batch;
+        pool.start(job, task, batch.size());
+    }
+
+    if (!pool.wait(job)) {
+        warning("read_chunks_parallel: Decompression failed.");
+        return false;
+    }
+    if (use_cache)
+        insert_decoded_chunks(cache_key, batches[(num_batches - 1) % 2]);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef HAVE_DIRECT_CHUNK_READ
+/**
+ * Chunks to be decompressed into the decoded chunk cache ahead of reads.
+ */
+struct readahead_job_t
+{
+    std::string                         filename;
+    std::string                         location;
+    std::string                         cache_key;
+    unsigned long                       generation;     // See decoded_cache_generation()
+    std::size_t                         elemsize;
+    std::size_t                         chunk_bytes;
+    std::vector<chunk_filter_t>         filters;
+    std::vector<std::vector<hsize_t> >  chunks;         // Element offsets of chunks
+};
+
+// Number of frames decompressed ahead of sequential slice reads, 0 disables readahead.
+static unsigned readahead_frames = 4;
+
+// State of readahead thread, guarded by readahead_mutex
+static mutex_t          readahead_mutex;
+static readahead_job_t* readahead_next = NULL;      // Job to be run next
+static bool             readahead_running = false;
+static bool             readahead_cancel = false;   // Abort running job
+static bool             readahead_quit = false;
+static HANDLE           readahead_thread = NULL;
+static event_t          readahead_event;            // Signaled when a job is queued
+static event_t          readahead_done(true);       // Signaled when a job finished
+
+// Number of chunks decompressed by readahead. Guarded by the library lock.
+static unsigned long    readahead_chunk_count = 0;
+
+// Returns whether the running job should be aborted.
+static bool readahead_aborted()
+{
+    scoped_lock_t lock(readahead_mutex);
+    return readahead_cancel || readahead_quit || readahead_next != NULL;
+}
+
+static void run_readahead(const readahead_job_t& job)
+{
+    for (std::size_t k = 0; k < job.chunks.size() && !readahead_aborted(); ++k) {
+        raw_chunk_t chunk;
+        chunk.offset = job.chunks[k];
+
+        // The library is only locked while reading, the script may read meanwhile
+        {
+            library_lock_t lock;
+            if (decoded_cache_generation() != job.generation)
+                return;
+            if (decoded_cache_contains(job.cache_key, chunk.offset))
+                continue;
+
+            file_handle_t file = open_file(job.filename.c_str(), H5F_ACC_RDONLY);
+            if (!file.valid())
+                return;
+            dataset_handle_t data = open_cached_dataset(file.get(), job.location.c_str());
+            if (!data.valid() || !read_raw_chunk(data.get(), chunk))
+                return;
+        }
+
+        // Unallocated chunks need not be read ahead
+        if (chunk.data.empty())
+            continue;
+        if (!remove_filters(job.filters, job.elemsize, job.chunk_bytes, chunk.data, chunk.filter_mask))
+            return;
+
+        library_lock_t lock;
+        if (decoded_cache_generation() != job.generation)
+            return;
+        decoded_cache_insert(job.cache_key, chunk.offset, chunk.data);
+        ++readahead_chunk_count;
+    }
+}
+
+static unsigned __stdcall readahead_thread_main(void*)
+{
+    register_background_thread(true);
+    for (;;) {
+        readahead_job_t* job = NULL;
+        {
+            scoped_lock_t lock(readahead_mutex);
+            if (readahead_quit)
+                break;
+            job = readahead_next;
+            readahead_next = NULL;
+            readahead_running = job != NULL;
+
+            // A cancel only applies to the job running at that time
+            readahead_cancel = false;
+        }
+
+        if (!job) {
+            readahead_event.wait();
+            continue;
+        }
+
+        try {
+            run_readahead(*job);
+        } catch (...) {
+        }
+        delete job;
+
+        scoped_lock_t lock(readahead_mutex);
+        readahead_running = false;
+        readahead_cancel = false;
+        readahead_done.set();
+    }
+    register_background_thread(false);
+    return 0;
+}
+#endif
+
+void readahead_chunks(hid_t dset_id, const char* filename, const std::string& location, 
+                      const hsize_t* offset, const hsize_t* stride, const hsize_t* count, const hsize_t* step)
+{
+#ifdef HAVE_DIRECT_CHUNK_READ
+    if (readahead_frames == 0)
+        return;
+
+    std::auto_ptr<readahead_job_t> job(new readahead_job_t);
+    job->cache_key = decoded_cache_key(dset_id);
+    if (job->cache_key.empty())
+        return;
+
+    type_handle_t type(H5Dget_type(dset_id));
+    plist_handle_t dcpl(H5Dget_create_plist(dset_id));
+    chunk_layout_t layout;
+    if (!type.valid() || !dcpl.valid() || !get_chunk_layout(dset_id, dcpl.get(), H5Tget_size(type.get()), layout)
+        || !get_chunk_filters(dcpl.get(), job->filters))
+        return;
+
+    // Chunks of the following frames, which are not cached yet. At most a quarter
+    // of the cache is filled, so the chunks of the current frame are not evicted.
+    std::size_t max_bytes = get_decoded_cache_size() / 4;
+    std::size_t nbytes = 0;
+    std::set<std::vector<hsize_t> > seen;
+    chunk_selection_t selection;
+    selection.offset.assign(offset, offset + layout.rank);
+    selection.stride.assign(stride, stride + layout.rank);
+    selection.count.assign(count, count + layout.rank);
+    for (unsigned frame = 0; frame < readahead_frames && nbytes + layout.chunk_bytes <= max_bytes; ++frame) {
+        for (int n = 0; n < layout.rank; ++n)
+            selection.offset[n] += step[n];
+
+        std::vector<std::vector<hsize_t> > hits;
+        hsize_t num_chunks = selection.chunks(layout, hits);
+        std::vector<std::size_t> index(layout.rank, 0);
+        for (hsize_t k = 0; k < num_chunks && nbytes + layout.chunk_bytes <= max_bytes; ++k) {
+            std::vector<hsize_t> chunk_offset(layout.rank);
+            for (int n = 0; n < layout.rank; ++n)
+                chunk_offset[n] = hits[n][index[n]];
+
+            // Next chunk in row-major order
+            for (int n = layout.rank - 1; n >= 0; --n) {
+                if (++index[n] < hits[n].size())
+                    break;
+                index[n] = 0;
+            }
+
+            if (seen.insert(chunk_offset).second && !decoded_cache_contains(job->cache_key, chunk_offset)) {
+                job->chunks.push_back(chunk_offset);
+                nbytes += layout.chunk_bytes;
+            }
+        }
+    }
+    if (job->chunks.empty())
+        return;
+
+    job->filename = filename;
+    job->location = location;
+    job->generation = decoded_cache_generation();
+    job->elemsize = layout.elemsize;
+    job->chunk_bytes = layout.chunk_bytes;
+
+    // A new job replaces the previous one
+    scoped_lock_t lock(readahead_mutex);
+    if (!readahead_thread) {
+        readahead_quit = false;
+        readahead_thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL, 0, &readahead_thread_main, NULL, 0, NULL));
+        if (!readahead_thread)
+            return;
+    }
+    delete readahead_next;
+    readahead_next = job.release();
+    readahead_event.set();
+#endif
+}
+
+void cancel_readahead()
+{
+#ifdef HAVE_DIRECT_CHUNK_READ
+    for (;;) {
+        {
+            scoped_lock_t lock(readahead_mutex);
+            delete readahead_next;
+            readahead_next = NULL;
+            readahead_done.reset();
+            readahead_cancel = readahead_running;
+            if (!readahead_running)
+                return;
+        }
+        readahead_done.wait(100);
+    }
+#endif
+}
+
+void wait_readahead()
+{
+#ifdef HAVE_DIRECT_CHUNK_READ
+    for (;;) {
+        {
+            scoped_lock_t lock(readahead_mutex);
+            if (!readahead_running && !readahead_next)
+                return;
+            readahead_done.reset();
+        }
+        readahead_done.wait(100);
+    }
+#endif
+}
+
+void readahead_stats(DM::TagGroup& tags)
+{
+    tags.SetTagAsUInt32("ReadaheadChunks", readahead_chunk_count);
+}
+
+void stop_readahead()
+{
+#ifdef HAVE_DIRECT_CHUNK_READ
+    cancel_readahead();
+
+    HANDLE thread = NULL;
+    {
+        scoped_lock_t lock(readahead_mutex);
+        readahead_quit = true;
+        thread = readahead_thread;
+        readahead_thread = NULL;
+        readahead_event.set();
+    }
+
+    if (thread) {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+    }
+#endif
+}
+
+void h5_set_readahead(long frames)
+{
+#ifdef HAVE_DIRECT_CHUNK_READ
+    readahead_frames = frames > 0 ? unsigned(frames) : 0;
+#endif
+}
+
+worker_pool_t& get_worker_pool()
+{
+    if (!worker_pool)
+        worker_pool = new worker_pool_t(num_worker_threads);
+    return *worker_pool;
+}
+
+void stop_worker_pool()
+{
+    delete worker_pool;
+    worker_pool = NULL;
+}
+
+void h5_set_num_threads(long num)
+{
+    library_lock_t lock;
+    unsigned threads = num > 0 ? unsigned(num) : 0;
+    if (threads != num_worker_threads) {
+        // Recreated with the new size on next use
+        num_worker_threads = threads;
+        stop_worker_pool();
+    }
+}
@@ -1,6 +1,7 @@
 #include "plugin.h"
 #include "scopedptr.h"
 #include <vector>
+#include <map>
 
 using namespace Gatan;
 
@@ -34,7 +35,7 @@ static void read_scalar_attr(const char* attr_name, hid_t attr_id, hid_t type_id
     case H5T_STRING:
         if (H5Tis_variable_str(type_id)) {
             // variable length string
-            scoped_ptr<char, free> data;
+            scoped_ptr<char, free_HDF> data;
 
             type_handle_t strtype(H5Tcopy(H5T_C_S1));
             H5Tset_size(strtype.get(), H5T_VARIABLE);
@@ -164,7 +165,7 @@ static void read_array_attr(const char* attr_name, hid_t attr_id, hid_t type_id,
             H5Tset_size(strtype.get(), H5T_VARIABLE);
             H5Tset_cset(strtype.get(), H5T_CSET_UTF8);
 
-            scoped_ptr_array<char, free> data(static_cast<std::size_t>(size));
+            scoped_ptr_array<char, free_HDF> data(static_cast<std::size_t>(size));
             if (H5Aread(attr_id, strtype.get(), data.unsafe_data()) < 0)
                 return;
 
@@ -223,66 +224,364 @@ static void read_array_attr(const char* attr_name, hid_t attr_id, hid_t type_id,
     tags.SetTagAsTagGroup(attr_name, list[0]);
 }
 
-static herr_t attr_iterator(hid_t loc_id, const char *attr_name, const H5A_info_t *ainfo, DM::TagGroup *tags)
+/**
+ * Reads a numeric attribute into an image with one H5Aread.
+ * @returns Invalid image, if the attribute is not numeric or can't be read.
+ */
+static DM::Image read_attr_image(hid_t attr_id, hid_t type_id, hid_t space_id)
 {
-    // Open attribute
-    attr_handle_t attr(H5Aopen(loc_id, attr_name, H5P_DEFAULT));
-    if (!attr.valid()) {
-        debug("get_attr_operator: Error opening attribute \"%s\".\n", attr_name);
-        return 0;
+    std::vector<hsize_t> dims;
+    long dtype = datatype_from_HDF(type_id);
+    if (dtype < 0 || hsize_array_from_HDF5(space_id, dims) < 0 || dims.size() > 4)
+        return DM::Image();
+
+    DM::Image image = create_image(dtype, dims.size(), dims.empty() ? NULL : &dims[0]);
+    if (!image.IsValid())
+        return DM::Image();
+
+    type_handle_t memtype = datatype_to_HDF(dtype);
+    herr_t err;
+    {
+        PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_READ
+                                               | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+        err = H5Aread(attr_id, memtype.get(), imageLock.get());
+        image.DataChanged();
     }
+    if (err < 0)
+        return DM::Image();
 
-    space_handle_t space(H5Aget_space(attr.get()));
+    return image;
+}
+
+/**
+ * Reads an attribute into tags.
+ * @param image_threshold Numeric one dimensional arrays with at least this number of elements
+ *                        are stored as array tags, negative to always store them as tag lists.
+ *                        Array tags don't keep the extents of higher ranks, so those are
+ *                        always stored as tag lists.
+ */
+static void read_attr(const char* attr_name, hid_t attr_id, long image_threshold, DM::TagGroup& tags)
+{
+    space_handle_t space(H5Aget_space(attr_id));
     if (!space.valid())
-        return 0;
+        return;
 
     int rank = H5Sget_simple_extent_ndims(space.get());
     if (rank < 0)
-        return 0;
+        return;
 
     // Dump type info
-    type_handle_t type(H5Aget_type(attr.get()));
+    type_handle_t type(H5Aget_type(attr_id));
     if (!type.valid())
-        return 0;
+        return;
 
     try {
         if (rank == 0)
-            read_scalar_attr(attr_name, attr.get(), type.get(), *tags);
-        else
-            read_array_attr(attr_name, attr.get(), type.get(), space.get(), *tags);
+            read_scalar_attr(attr_name, attr_id, type.get(), tags);
+        else {
+            if (rank == 1 && image_threshold >= 0 && H5Sget_simple_extent_npoints(space.get()) >= image_threshold) {
+                DM::Image image = read_attr_image(attr_id, type.get(), space.get());
+                if (image.IsValid()) {
+                    tags.SetTagAsArray(attr_name, image);
+                    return;
+                }
+            }
+            read_array_attr(attr_name, attr_id, type.get(), space.get(), tags);
+        }
     } catch (...) {
         // pass
     }
+}
 
+struct attr_reader_t
+{
+    DM::TagGroup tags;
+    long         image_threshold;
+};
+
+static herr_t attr_iterator(hid_t loc_id, const char *attr_name, const H5A_info_t *ainfo, attr_reader_t *reader)
+{
+    // Open attribute
+    attr_handle_t attr(H5Aopen(loc_id, attr_name, H5P_DEFAULT));
+    if (!attr.valid()) {
+        debug("get_attr_operator: Error opening attribute \"%s\".\n", attr_name);
+        return 0;
+    }
+
+    read_attr(attr_name, attr.get(), reader->image_threshold, reader->tags);
     return 0;
 }
 
+/**
+ * Reads attributes of an object.
+ * @param names Names of attributes to read (UTF-8), NULL to read all attributes.
+ * @param image_threshold See read_attr().
+ */
+static DM::TagGroup read_attributes(const char* filename, DM_StringToken location, const std::vector<std::string>* names, long image_threshold)
+{
+    library_lock_t lock(filename);
+    file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
+    if (!file.valid()) {
+        warning("h5_read_attr: Can't open file '%s'.", filename);
+        return DM::TagGroup();
+    }
+
+    std::string loc_name = to_UTF8(DM::String(location));
+    object_handle_t loc(H5Oopen(file.get(), loc_name.c_str(), H5P_DEFAULT));
+    if (!loc.valid()) {
+        warning("h5_read_attr: Invalid location '%s'.", loc_name.c_str());
+        return DM::TagGroup();
+    }
+
+    attr_reader_t reader;
+    reader.tags = DM::NewTagGroup();
+    reader.image_threshold = image_threshold;
+    if (!names) {
+        hsize_t index = 0;
+        H5Aiterate(loc.get(), H5_INDEX_NAME, H5_ITER_NATIVE, &index, (H5A_operator2_t)attr_iterator, &reader);
+        return reader.tags;
+    }
+
+    // Only the requested attributes are opened, missing ones are skipped
+    for (std::vector<std::string>::const_iterator iter = names->begin(); iter != names->end(); ++iter) {
+        if (H5Aexists_by_name(loc.get(), ".", iter->c_str(), H5P_DEFAULT) <= 0)
+            continue;
+
+        attr_handle_t attr(H5Aopen_by_name(loc.get(), ".", iter->c_str(), H5P_DEFAULT, H5P_DEFAULT));
+        if (!attr.valid()) {
+            debug("h5_read_attr: Error opening attribute \"%s\".\n", iter->c_str());
+            continue;
+        }
+
+        read_attr(iter->c_str(), attr.get(), reader.image_threshold, reader.tags);
+    }
+    return reader.tags;
+}
+
 DM_TagGroupToken_1Ref h5_read_attr(const char* filename, DM_StringToken location)
 {
     DM::TagGroup tags;
 
     PLUG_IN_ENTRY
 
-        file_handle_t file(H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT));
+        tags = read_attributes(filename, location, NULL, -1);
+
+    PLUG_IN_EXIT
+
+    return tags.release();
+}
+
+DM_TagGroupToken_1Ref h5_read_attr_threshold(const char* filename, DM_StringToken location, long image_threshold)
+{
+    DM::TagGroup tags;
+
+    PLUG_IN_ENTRY
+
+        if (image_threshold < 0) {
+            warning("h5_read_attr: Image threshold must not be negative.");
+            return NULL;
+        }
+        tags = read_attributes(filename, location, NULL, image_threshold);
+
+    PLUG_IN_EXIT
+
+    return tags.release();
+}
+
+DM_TagGroupToken_1Ref h5_read_attr_names(const char* filename, DM_StringToken location, DM_TagGroupToken names_token)
+{
+    DM::TagGroup tags;
+
+    PLUG_IN_ENTRY
+
+        DM::TagGroup names_tags(names_token);
+        if (!names_tags.IsValid() || !names_tags.IsList()) {
+            warning("h5_read_attr: names must be tag list.");
+            return NULL;
+        }
+
+        std::vector<std::string> names;
+        for (long n = 0; n < names_tags.CountTags(); ++n) {
+            DM::String name;
+            if (!names_tags.GetIndexedTagAsString(n, &name)) {
+                warning("h5_read_attr: names must contain strings only.");
+                return NULL;
+            }
+            names.push_back(to_UTF8(name));
+        }
+
+        tags = read_attributes(filename, location, &names, -1);
+
+    PLUG_IN_EXIT
+
+    return tags.release();
+}
+
+DM_ImageToken_1Ref h5_read_attr_array(const char* filename, DM_StringToken location, DM_StringToken name)
+{
+    DM::Image image;
+
+    PLUG_IN_ENTRY
+
+        library_lock_t lock(filename);
+        file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
         if (!file.valid()) {
-            warning("h5_read_attr: Can't open file '%s'.", filename);
+            warning("h5_read_attr_array: Can't open file '%s'.", filename);
             return NULL;
         }
 
         std::string loc_name = to_UTF8(DM::String(location));
         object_handle_t loc(H5Oopen(file.get(), loc_name.c_str(), H5P_DEFAULT));
         if (!loc.valid()) {
-            warning("h5_read_attr: Invalid location '%s'.", loc_name.c_str());
+            warning("h5_read_attr_array: Invalid location '%s'.", loc_name.c_str());
+            return NULL;
+        }
+
+        std::string attr_name = to_UTF8(DM::String(name));
+        attr_handle_t attr(H5Aopen(loc.get(), attr_name.c_str(), H5P_DEFAULT));
+        if (!attr.valid()) {
+            warning("h5_read_attr_array: Can't open attribute '%s'.", attr_name.c_str());
+            return NULL;
+        }
+
+        space_handle_t space(H5Aget_space(attr.get()));
+        type_handle_t type(H5Aget_type(attr.get()));
+        if (!space.valid() || !type.valid()) {
+            warning("h5_read_attr_array: Reading type or data space of attribute '%s' failed.", attr_name.c_str());
+            return NULL;
+        }
+
+        image = read_attr_image(attr.get(), type.get(), space.get());
+        if (!image.IsValid()) {
+            warning("h5_read_attr_array: Attribute '%s' is not a numeric array of rank 0 to 4.", attr_name.c_str());
             return NULL;
         }
-        
-        tags = DM::NewTagGroup();
-        hsize_t index = 0;
-        H5Aiterate(loc.get(), H5_INDEX_NAME, H5_ITER_NATIVE, &index, (H5A_operator2_t)attr_iterator, &tags);
 
     PLUG_IN_EXIT
 
-    return tags.release();
+    return image.release();
+}
+
+// Querying only the needed object info fields was added in HDF5 1.10.3
+#if H5_VERSION_GE(1, 10, 3)
+#   define get_object_info(obj_id, info) H5Oget_info2(obj_id, info, H5O_INFO_BASIC | H5O_INFO_NUM_ATTRS)
+#else
+#   define get_object_info(obj_id, info) H5Oget_info(obj_id, info)
+#endif
+
+struct attr_tree_t
+{
+    long                    max_depth;  // Negative for unlimited depth
+    std::map<haddr_t, long> visited;    // Objects already listed and their least depth
+    DM::TagGroup            tags;       // List of {"Path", "Attributes"}
+};
+
+static void read_attr_tree(hid_t obj_id, const std::string& path, long depth, attr_tree_t& tree);
+
+struct attr_tree_group_t
+{
+    attr_tree_t*       tree;
+    const std::string* path;        // Path of the group (UTF-8)
+    long               depth;       // Levels of the group below root
+};
+
+static herr_t attr_tree_iterator(hid_t group_id, const char* name, const H5L_info_t* info, void* op_data)
+{
+    // Soft and external links are not followed
+    if (info->type != H5L_TYPE_HARD)
+        return 0;
+
+    attr_tree_group_t* group = static_cast<attr_tree_group_t*>(op_data);
+    object_handle_t obj(H5Oopen_by_addr(group_id, info->u.address));
+    if (!obj.valid()) {
+        debug("h5_read_attr_tree: Error opening object \"%s\".\n", name);
+        return 0;
+    }
+
+    std::string path = *group->path;
+    if (path != "/")
+        path += '/';
+    read_attr_tree(obj.get(), path + name, group->depth + 1, *group->tree);
+    return 0;
+}
+
+// Lists attributes of object and descends into groups until max_depth is reached.
+static void read_attr_tree(hid_t obj_id, const std::string& path, long depth, attr_tree_t& tree)
+{
+    H5O_info_t info;
+    if (get_object_info(obj_id, &info) < 0)
+        return;
+
+    // Objects with several hard links are listed once, but a group found again
+    // closer to root is iterated again, so that depth covers all its links
+    std::map<haddr_t, long>::iterator visited = tree.visited.find(info.addr);
+    bool listed = visited != tree.visited.end();
+    if (listed && visited->second <= depth)
+        return;
+    tree.visited[info.addr] = depth;
+
+    // Objects without attributes are not listed
+    if (!listed && info.num_attrs > 0) {
+        try {
+            attr_reader_t reader;
+            reader.tags = DM::NewTagGroup();
+            reader.image_threshold = -1;
+            hsize_t index = 0;
+            H5Aiterate(obj_id, H5_INDEX_NAME, H5_ITER_NATIVE, &index, (H5A_operator2_t)attr_iterator, &reader);
+
+            DM::TagGroup entry = DM::NewTagGroup();
+            entry.SetTagAsString("Path", from_UTF8(path));
+            entry.SetTagAsTagGroup("Attributes", reader.tags);
+            tree.tags.AddTagGroupAtEnd(entry);
+        } catch (...) {
+            // pass
+        }
+    }
+
+    // Levels below max_depth are not iterated at all
+    if (info.type != H5O_TYPE_GROUP || (tree.max_depth >= 0 && depth >= tree.max_depth))
+        return;
+
+    attr_tree_group_t group = { &tree, &path, depth };
+    hsize_t index = 0;
+    if (H5Literate(obj_id, H5_INDEX_NAME, H5_ITER_INC, &index, (H5L_iterate_t)attr_tree_iterator, &group) < 0)
+        debug("h5_read_attr_tree: Error iterating group \"%s\".\n", path.c_str());
+}
+
+DM_TagGroupToken_1Ref h5_read_attr_tree(const char* filename, DM_StringToken root, long depth)
+{
+    attr_tree_t tree;
+
+    PLUG_IN_ENTRY
+
+        library_lock_t lock(filename);
+        file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
+        if (!file.valid()) {
+            warning("h5_read_attr_tree: Can't open file '%s'.", filename);
+            return NULL;
+        }
+
+        std::string root_name = to_UTF8(DM::String(root));
+        object_handle_t loc(H5Oopen(file.get(), root_name.c_str(), H5P_DEFAULT));
+        if (!loc.valid()) {
+            warning("h5_read_attr_tree: Invalid location '%s'.", root_name.c_str());
+            return NULL;
+        }
+
+        // Absolute path of root without trailing slash
+        std::string path = root_name;
+        while (!path.empty() && path[path.size() - 1] == '/')
+            path.erase(path.size() - 1);
+        if (path.empty() || path[0] != '/')
+            path.insert(0, 1, '/');
+
+        tree.max_depth = depth;
+        tree.tags = DM::NewTagList();
+        read_attr_tree(loc.get(), path, 0, tree);
+
+    PLUG_IN_EXIT
+
+    return tree.tags.release();
 }
 
 bool h5_exists_attr(const char* filename, DM_StringToken location, DM_StringToken attr)
@@ -291,7 +590,8 @@ bool h5_exists_attr(const char* filename, DM_StringToken location, DM_StringToke
 
     PLUG_IN_ENTRY
 
-        file_handle_t file(H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT));
+        library_lock_t lock(filename);
+        file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
         if (!file.valid()) {
             warning("h5_attr_exists: Can't open file '%s'.", filename);
             return NULL;
@@ -320,7 +620,8 @@ bool h5_delete_attr(const char* filename, DM_StringToken location, DM_StringToke
 {
     PLUG_IN_ENTRY
 
-        file_handle_t file(H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT));
+        library_lock_t lock(filename);
+        file_handle_t file = open_file(filename, H5F_ACC_RDWR);
         if (!file.valid()) {
             warning("h5_delete_attr: Can't open file '%s'.", filename);
             return false;
@@ -339,6 +640,8 @@ bool h5_delete_attr(const char* filename, DM_StringToken location, DM_StringToke
             return false;
         }
 
+        flush_file(file.get());
+
     PLUG_IN_EXIT
 
     return true;
@@ -1,115 +1,714 @@
 #include "plugin.h"
 #include "scopedptr.h"
+#include <windows.h>
+#include <algorithm>
+#include <memory>
+#include <math.h>
 
 using namespace Gatan;
 
-bool h5_create_dataset_from_image(const char* filename, DM_StringToken location, DM_ImageToken image_token)
+// Whether contiguous datasets are read directly from the file
+static bool direct_read_enabled = true;
+
+// Number of datasets read directly from the file. Guarded by the library lock.
+static unsigned long direct_read_count = 0;
+
+static bool read_file_at(HANDLE handle, hsize_t offset, char* ptr, hsize_t nbytes)
 {
-    PLUG_IN_ENTRY
+    const hsize_t block_size = 64 * 1024 * 1024;
 
-        DM::Image image(image_token);
+    while (nbytes > 0) {
+        DWORD todo = DWORD(std::min(nbytes, block_size));
+
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = DWORD(offset & 0xffffffff);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+
+        DWORD done = 0;
+        if (!ReadFile(handle, ptr, todo, &done, &overlapped) || done != todo)
+            return false;
+
+        offset += todo;
+        ptr += todo;
+        nbytes -= todo;
+    }
+
+    return true;
+}
+
+/**
+ * Reads whole dataset directly from the file, if it is stored contiguously 
+ * in the file and no type conversion is necessary.
+ * @returns Whether data was read, if not H5Dread must be used.
+ */
+static bool read_contiguous_direct(hid_t dset_id, hid_t memtype_id, void* buffer, hsize_t nbytes)
+{
+    if (!direct_read_enabled || nbytes == 0)
+        return false;
+
+    plist_handle_t dcpl(H5Dget_create_plist(dset_id));
+    if (!dcpl.valid() || H5Pget_layout(dcpl.get()) != H5D_CONTIGUOUS || H5Pget_external_count(dcpl.get()) != 0)
+        return false;
+
+    type_handle_t type(H5Dget_type(dset_id));
+    if (!type.valid() || H5Tequal(type.get(), memtype_id) <= 0)
+        return false;
+
+    // Unallocated datasets (only fill values) have no offset
+    haddr_t offset = H5Dget_offset(dset_id);
+    if (offset == HADDR_UNDEF || H5Dget_storage_size(dset_id) != nbytes)
+        return false;
+
+    // Offsets are only meaningful for the default driver
+    file_handle_t file(H5Iget_file_id(dset_id));
+    plist_handle_t fapl(file.valid() ? H5Fget_access_plist(file.get()) : -1);
+    if (!fapl.valid() || H5Pget_driver(fapl.get()) != H5FD_SEC2)
+        return false;
+
+    // Written data might still be in HDF5's buffers
+    unsigned intent = 0;
+    if (H5Fget_intent(file.get(), &intent) < 0)
+        return false;
+    if ((intent & H5F_ACC_RDWR) && H5Fflush(file.get(), H5F_SCOPE_LOCAL) < 0)
+        return false;
+
+    ssize_t name_len = H5Fget_name(file.get(), NULL, 0);
+    if (name_len <= 0)
+        return false;
+    std::vector<char> filename(name_len + 1);
+    if (H5Fget_name(file.get(), &filename[0], filename.size()) < 0)
+        return false;
+
+    HANDLE handle = CreateFileA(&filename[0], GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, 
+                                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        debug("read_contiguous_direct: Can't open '%s' (error %u).\n", &filename[0], unsigned(GetLastError()));
+        return false;
+    }
 
-        type_handle_t memtype = datatype_to_HDF(image.GetDataType());
-        if (!memtype.valid()) {
-            warning("h5_create_dataset: Unsupported image type.");
+    bool success = read_file_at(handle, offset, static_cast<char*>(buffer), nbytes);
+    if (success)
+        ++direct_read_count;
+    else
+        debug("read_contiguous_direct: Reading '%s' failed (error %u).\n", &filename[0], unsigned(GetLastError()));
+
+    CloseHandle(handle);
+    return success;
+}
+
+void h5_set_direct_read(bool enable)
+{
+    direct_read_enabled = enable;
+}
+
+unsigned long get_direct_read_count()
+{
+    return direct_read_count;
+}
+
+/**
+ * Storage options of a new dataset, read from the options TagGroup
+ * by parse_create_options().
+ */
+struct create_options_t
+{
+    std::vector<hsize_t> chunk;             // Empty for contiguous layout
+    long                 deflate;           // Compression level, -1 for none
+    bool                 shuffle;
+    bool                 fletcher32;
+    bool                 set_fill_value;
+    double               fill_value;
+    bool                 set_alloc_time;
+    H5D_alloc_time_t     alloc_time;
+    bool                 set_fill_time;
+    H5D_fill_time_t      fill_time;
+
+    create_options_t()
+    : deflate(-1), shuffle(false), fletcher32(false), set_fill_value(false), fill_value(0),
+      set_alloc_time(false), alloc_time(H5D_ALLOC_TIME_DEFAULT), set_fill_time(false), fill_time(H5D_FILL_TIME_IFSET)
+    {}
+};
+
+/**
+ * Reads creation options. Does not call the HDF5 library.
+ * @param options TagGroup with creation options, may be invalid.
+ * @param rank Rank of dataset.
+ * @param dims Extents of dataset (HDF5 order).
+ * @param maxdims Maximum extents of dataset, NULL if same as @p dims. Extendible datasets are always chunked.
+ * @param dtype DM data type of dataset.
+ * @param result OUT: Options.
+ * @returns Whether succeeded.
+ */
+static bool parse_create_options(const DM::TagGroup& options, int rank, const hsize_t* dims, const hsize_t* maxdims, long dtype, create_options_t& result)
+{
+    if (!maxdims)
+        maxdims = dims;
+    bool extendible = false;
+    for (int n = 0; n < rank; ++n)
+        extendible = extendible || maxdims[n] != dims[n];
+
+    bool sparse = false;
+    if (options.IsValid()) {
+        options.GetTagAsLong("Deflate", &result.deflate);
+        options.GetTagAsBoolean("Shuffle", &result.shuffle);
+        options.GetTagAsBoolean("Fletcher32", &result.fletcher32);
+        options.GetTagAsBoolean("Sparse", &sparse);
+    }
+    if (result.deflate > 9) {
+        warning("h5_create_dataset: Deflate level must be between 0 and 9.");
+        return false;
+    }
+
+    DM::TagGroup chunk_tags;
+    if (options.IsValid() && options.GetTagAsTagGroup("ChunkSize", &chunk_tags)) {
+        result.chunk = hsize_array_from_taglist(chunk_tags);
+        if (int(result.chunk.size()) != rank) {
+            warning("h5_create_dataset: ChunkSize must be tag list with %d entries.", rank);
             return false;
         }
+        for (int n = 0; n < rank; ++n) 
+            if (result.chunk[n] <= 0 || (maxdims[n] != H5S_UNLIMITED && result.chunk[n] > maxdims[n])) {
+                warning("h5_create_dataset: ChunkSize entries must be positive and not larger than the dataset.");
+                return false;
+            }
+    } else if (result.deflate >= 0 || result.shuffle || result.fletcher32 || extendible || sparse) {
+        // Filters and sparse storage require chunks, default is one plane of the two fastest varying dimensions
+        result.chunk.assign(dims, dims + rank);
+        for (int n = 0; n < rank - 2; ++n)
+            result.chunk[n] = 1;
+    }
 
-        int rank = DM::ImageGetNumDimensions(image);
-        std::vector<hsize_t> dims(rank);
-        for (int i = 0; i < rank; i++) 
-             dims[rank - 1 - i] = DM::ImageGetDimensionSize(image, i);
+    if (!options.IsValid())
+        return true;
 
-        space_handle_t space(H5Screate_simple(rank, &dims[0], NULL));
-        if (!space.valid()) {
-            warning("h5_create_dataset: Creation of dataspace failed.");
-            dump_HDF_error_stack();
+    if (options.GetTagAsDouble("FillValue", &result.fill_value)) {
+        if (dtype == ImageData::COMPLEX8_DATA || dtype == ImageData::COMPLEX16_DATA) {
+            warning("h5_create_dataset: FillValue not supported for complex data.");
             return false;
         }
+        result.set_fill_value = true;
+    }
 
-        file_handle_t file = open_always(filename);
-        if (!file.valid()) {
-            warning("h5_create_dataset: Can't open file '%s'.", filename);
+    DM::String alloc_time_str;
+    if (options.GetTagAsString("AllocTime", &alloc_time_str)) {
+        std::string alloc_time = to_UTF8(alloc_time_str);
+        if (_stricmp(alloc_time.c_str(), "default") == 0)
+            result.alloc_time = H5D_ALLOC_TIME_DEFAULT;
+        else if (_stricmp(alloc_time.c_str(), "early") == 0)
+            result.alloc_time = H5D_ALLOC_TIME_EARLY;
+        else if (_stricmp(alloc_time.c_str(), "incr") == 0)
+            result.alloc_time = H5D_ALLOC_TIME_INCR;
+        else if (_stricmp(alloc_time.c_str(), "late") == 0)
+            result.alloc_time = H5D_ALLOC_TIME_LATE;
+        else {
+            warning("h5_create_dataset: AllocTime must be \"Default\", \"Early\", \"Incr\", or \"Late\".");
             return false;
         }
+        result.set_alloc_time = true;
+    }
 
-        std::string loc_name = to_UTF8(DM::String(location));
-        dataset_handle_t data(H5Dcreate(file.get(), loc_name.c_str(), memtype.get(), space.get(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
-        if (!data.valid()) {
-            warning("h5_create_dataset: Creation of dataset '%s' failed.", loc_name.c_str());
-            dump_HDF_error_stack();
+    if (sparse) {
+        // Only chunks written are allocated, so creation takes constant time
+        if (result.set_alloc_time && result.alloc_time == H5D_ALLOC_TIME_EARLY) {
+            warning("h5_create_dataset: AllocTime \"Early\" contradicts Sparse.");
             return false;
         }
+        result.set_alloc_time = true;
+        result.alloc_time = H5D_ALLOC_TIME_INCR;
+    }
 
-        herr_t err;
-        {
-            PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_WRITE
-                                                   | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
-            err = H5Dwrite(data.get(), memtype.get(), H5S_ALL, H5S_ALL, H5P_DEFAULT, imageLock.get());
+    DM::String fill_time_str;
+    if (options.GetTagAsString("FillTime", &fill_time_str)) {
+        std::string fill_time = to_UTF8(fill_time_str);
+        if (_stricmp(fill_time.c_str(), "ifset") == 0)
+            result.fill_time = H5D_FILL_TIME_IFSET;
+        else if (_stricmp(fill_time.c_str(), "alloc") == 0)
+            result.fill_time = H5D_FILL_TIME_ALLOC;
+        else if (_stricmp(fill_time.c_str(), "never") == 0)
+            result.fill_time = H5D_FILL_TIME_NEVER;
+        else {
+            warning("h5_create_dataset: FillTime must be \"IfSet\", \"Alloc\", or \"Never\".");
+            return false;
         }
-        if (err < 0) {
-            warning("h5_create_dataset: Writing of dataset failed.");
+        result.set_fill_time = true;
+    }
+
+    return true;
+}
+
+/**
+ * Creates dataset creation property list from options.
+ * @param options Creation options.
+ * @param rank Rank of dataset.
+ * @param dcpl OUT: Property list.
+ * @returns Whether succeeded.
+ */
+static bool create_dataset_plist(const create_options_t& options, int rank, plist_handle_t& dcpl)
+{
+    dcpl.reset(H5Pcreate(H5P_DATASET_CREATE));
+    if (!dcpl.valid()) {
+        warning("h5_create_dataset: Creation of property list failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    if (!options.chunk.empty() && rank > 0 && H5Pset_chunk(dcpl.get(), rank, &options.chunk[0]) < 0) {
+        warning("h5_create_dataset: Setting chunk size failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    if (options.shuffle && H5Pset_shuffle(dcpl.get()) < 0) {
+        warning("h5_create_dataset: Setting shuffle filter failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    if (options.deflate >= 0) {
+        if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) <= 0) {
+            warning("h5_create_dataset: Deflate filter not available.");
+            return false;
+        }
+        if (H5Pset_deflate(dcpl.get(), unsigned(options.deflate)) < 0) {
+            warning("h5_create_dataset: Setting deflate filter failed.");
             dump_HDF_error_stack();
             return false;
         }
+    }
 
-    PLUG_IN_EXIT
+    if (options.fletcher32 && H5Pset_fletcher32(dcpl.get()) < 0) {
+        warning("h5_create_dataset: Setting fletcher32 filter failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    if (options.set_fill_value && H5Pset_fill_value(dcpl.get(), H5T_NATIVE_DOUBLE, &options.fill_value) < 0) {
+        warning("h5_create_dataset: Setting fill value failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    if (options.set_alloc_time && H5Pset_alloc_time(dcpl.get(), options.alloc_time) < 0) {
+        warning("h5_create_dataset: Setting allocation time failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    if (options.set_fill_time && H5Pset_fill_time(dcpl.get(), options.fill_time) < 0) {
+        warning("h5_create_dataset: Setting fill time failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
 
     return true;
 }
 
-bool h5_create_dataset_simple(const char* filename, DM_StringToken location, long dtype, DM_TagGroupToken size_token)
+/**
+ * Creates a dataset and writes its data.
+ * @param func Name of calling function for warnings.
+ * @param dims, maxdims Extents and maximum extents (NULL for fixed size) of dataset (HDF5 order).
+ * @param buffer Data of the whole dataset of type @p dtype, NULL to leave the dataset empty.
+ * @returns Whether succeeded.
+ */
+static bool create_dataset(const char* func, const char* filename, const std::string& loc_name, long dtype,
+                           const std::vector<hsize_t>& dims, const hsize_t* maxdims, const create_options_t& options,
+                           const void* buffer)
 {
-    PLUG_IN_ENTRY
+    type_handle_t memtype = datatype_to_HDF(dtype);
+    if (!memtype.valid()) {
+        warning("%s: Unsupported image type.", func);
+        return false;
+    }
 
-        DM::TagGroup size_tags(size_token);
-        if (!size_tags.IsValid() || !size_tags.IsList()) {
-            warning("h5_create_dataset: size must be tag list.");
-            return false;
+    int rank = int(dims.size());
+    space_handle_t space(H5Screate_simple(rank, &dims[0], maxdims));
+    if (!space.valid()) {
+        warning("%s: Creation of dataspace failed.", func);
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    plist_handle_t dcpl;
+    if (!create_dataset_plist(options, rank, dcpl))
+        return false;
+
+    file_handle_t file = open_always(filename);
+    if (!file.valid()) {
+        warning("%s: Can't open file '%s'.", func, filename);
+        return false;
+    }
+
+    dataset_handle_t data(H5Dcreate(file.get(), loc_name.c_str(), memtype.get(), space.get(), H5P_DEFAULT, dcpl.get(), H5P_DEFAULT));
+    if (!data.valid()) {
+        warning("%s: Creation of dataset '%s' failed.", func, loc_name.c_str());
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    if (buffer && !write_chunks_parallel(data.get(), memtype.get(), buffer)
+        && H5Dwrite(data.get(), memtype.get(), H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer) < 0) {
+        warning("%s: Writing of dataset failed.", func);
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    flush_file(file.get());
+    return true;
+}
+
+// Returns extents of image in HDF5 order.
+static std::vector<hsize_t> image_dims(const DM::Image& image)
+{
+    int rank = DM::ImageGetNumDimensions(image);
+    std::vector<hsize_t> dims(rank);
+    for (int i = 0; i < rank; i++) 
+         dims[rank - 1 - i] = DM::ImageGetDimensionSize(image, i);
+    return dims;
+}
+
+/**
+ * Copies data of image for an asynchronous write.
+ * @returns false, if there is not enough memory for the copy.
+ */
+static bool snapshot_image(const DM::Image& image, std::vector<char>& data)
+{
+    std::size_t nbytes = DM::ImageGetDataElementByteSize(image);
+    std::vector<hsize_t> dims = image_dims(image);
+    for (std::vector<hsize_t>::const_iterator it = dims.begin(); it != dims.end(); ++it)
+        nbytes *= std::size_t(*it);
+
+    try {
+        data.resize(nbytes);
+    } catch (std::bad_alloc&) {
+        debug("snapshot_image: Not enough memory, writing synchronously.\n");
+        return false;
+    }
+
+    PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_WRITE
+                                           | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+    if (nbytes > 0)
+        memcpy(&data[0], imageLock.get(), nbytes);
+    return true;
+}
+
+// Asynchronous h5_create_dataset()
+struct create_dataset_job_t : public write_job_t
+{
+    long                 dtype;
+    std::vector<hsize_t> dims;
+    create_options_t     options;
+    std::vector<char>    data;
+
+    create_dataset_job_t(const char* filename, const std::string& location) : write_job_t(filename, location) {}
+
+    virtual bool run()
+    {
+        return create_dataset("h5_create_dataset", filename.c_str(), location, dtype, dims, NULL, options, data.empty() ? NULL : &data[0]);
+    }
+};
+
+static bool do_create_dataset_from_image(const char* filename, DM_StringToken location, DM::Image image, DM::TagGroup options)
+{
+    long dtype = image.GetDataType();
+    std::vector<hsize_t> dims = image_dims(image);
+    std::string loc_name = to_UTF8(DM::String(location));
+
+    create_options_t create_options;
+    if (!parse_create_options(options, int(dims.size()), &dims[0], NULL, dtype, create_options))
+        return false;
+
+    if (async_writes_enabled()) {
+        std::auto_ptr<create_dataset_job_t> job(new create_dataset_job_t(filename, loc_name));
+        if (snapshot_image(image, job->data)) {
+            job->dtype = dtype;
+            job->dims = dims;
+            job->options = create_options;
+            job->size = job->data.size();
+            queue_write(job.release());
+            return true;
         }
+    }
+
+    library_lock_t lock(filename);
+    PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_WRITE
+                                           | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+    return create_dataset("h5_create_dataset", filename, loc_name, dtype, dims, NULL, create_options, imageLock.get());
+}
 
-        std::vector<hsize_t> dims = hsize_array_from_taglist(size_tags);
-        if (dims.empty()) {
+static bool do_create_dataset_simple(const char* filename, DM_StringToken location, long dtype, DM_TagGroupToken size_token, DM::TagGroup options)
+{
+    DM::TagGroup size_tags(size_token);
+    if (!size_tags.IsValid() || !size_tags.IsList()) {
+        warning("h5_create_dataset: size must be tag list.");
+        return false;
+    }
+
+    std::vector<hsize_t> dims = hsize_array_from_taglist(size_tags);
+    if (dims.empty()) {
+        warning("h5_create_dataset: invalid size.");
+        return false;
+    }
+    for (std::vector<hsize_t>::const_iterator it = dims.begin(); it != dims.end(); ++it)
+        if (*it <= 0) {
             warning("h5_create_dataset: invalid size.");
             return false;
         }
-        for (std::vector<hsize_t>::const_iterator it = dims.begin(); it != dims.end(); ++it)
-            if (*it <= 0) {
-                warning("h5_create_dataset: invalid size.");
-                return false;
-            }
-        int rank = int(dims.size());
 
-        type_handle_t memtype = datatype_to_HDF(dtype);
-        if (!memtype.valid()) {
-            warning("h5_create_dataset: Unsupported image type.");
-            return false;
-        }
+    create_options_t create_options;
+    if (!parse_create_options(options, int(dims.size()), &dims[0], NULL, dtype, create_options))
+        return false;
 
-        space_handle_t space(H5Screate_simple(rank, &dims[0], NULL));
-        if (!space.valid()) {
-            warning("h5_create_dataset: Creation of dataspace failed.");
-            dump_HDF_error_stack();
-            return false;
-        }
+    library_lock_t lock(filename);
+    std::string loc_name = to_UTF8(DM::String(location));
+    return create_dataset("h5_create_dataset", filename, loc_name, dtype, dims, NULL, create_options, NULL);
+}
 
-        file_handle_t file = open_always(filename);
-        if (!file.valid()) {
-            warning("h5_create_dataset: Can't open file '%s'.", filename);
+bool h5_create_dataset_from_image(const char* filename, DM_StringToken location, DM_ImageToken image_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        result = do_create_dataset_from_image(filename, location, DM::Image(image_token), DM::TagGroup());
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+bool h5_create_dataset_from_image_opt(const char* filename, DM_StringToken location, DM_ImageToken image_token, DM_TagGroupToken options_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        result = do_create_dataset_from_image(filename, location, DM::Image(image_token), DM::TagGroup(options_token));
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+bool h5_create_dataset_simple(const char* filename, DM_StringToken location, long dtype, DM_TagGroupToken size_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        result = do_create_dataset_simple(filename, location, dtype, size_token, DM::TagGroup());
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+bool h5_create_dataset_simple_opt(const char* filename, DM_StringToken location, long dtype, DM_TagGroupToken size_token, DM_TagGroupToken options_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        result = do_create_dataset_simple(filename, location, dtype, size_token, DM::TagGroup(options_token));
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+static bool do_create_appendable_dataset(const char* filename, DM_StringToken location, long dtype, DM_TagGroupToken frame_size_token, DM::TagGroup options)
+{
+    DM::TagGroup frame_tags(frame_size_token);
+    if (!frame_tags.IsValid() || !frame_tags.IsList()) {
+        warning("h5_create_appendable_dataset: frame size must be tag list.");
+        return false;
+    }
+
+    // Frames are appended along the slowest varying dimension (the last one in DM)
+    std::vector<hsize_t> frame = hsize_array_from_taglist(frame_tags);
+    if (frame.empty()) {
+        warning("h5_create_appendable_dataset: invalid frame size.");
+        return false;
+    }
+    for (std::vector<hsize_t>::const_iterator it = frame.begin(); it != frame.end(); ++it)
+        if (*it <= 0) {
+            warning("h5_create_appendable_dataset: invalid frame size.");
             return false;
         }
+    int rank = int(frame.size()) + 1;
+
+    std::vector<hsize_t> dims(rank), maxdims(rank);
+    dims[0] = 0;
+    maxdims[0] = H5S_UNLIMITED;
+    for (int n = 1; n < rank; ++n)
+        dims[n] = maxdims[n] = frame[n - 1];
+
+    // Default chunk holds one frame
+    std::vector<hsize_t> frame_dims(dims);
+    frame_dims[0] = 1;
+    create_options_t create_options;
+    if (!parse_create_options(options, rank, &frame_dims[0], &maxdims[0], dtype, create_options))
+        return false;
+
+    library_lock_t lock(filename);
+    std::string loc_name = to_UTF8(DM::String(location));
+    return create_dataset("h5_create_appendable_dataset", filename, loc_name, dtype, dims, &maxdims[0], create_options, NULL);
+}
+
+bool h5_create_appendable_dataset(const char* filename, DM_StringToken location, long dtype, DM_TagGroupToken frame_size_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        result = do_create_appendable_dataset(filename, location, dtype, frame_size_token, DM::TagGroup());
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+bool h5_create_appendable_dataset_opt(const char* filename, DM_StringToken location, long dtype, DM_TagGroupToken frame_size_token, DM_TagGroupToken options_token)
+{
+    bool result = false;
 
+    PLUG_IN_ENTRY
+
+        result = do_create_appendable_dataset(filename, location, dtype, frame_size_token, DM::TagGroup(options_token));
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+/**
+ * Appends frames to an appendable dataset.
+ * @param counts Extents of data (HDF5 order), a frame or a stack of frames.
+ * @param buffer Data of type @p dtype.
+ * @returns Whether succeeded.
+ */
+static bool append_frames(const char* filename, const std::string& loc_name, long dtype, const std::vector<hsize_t>& counts, const void* buffer)
+{
+    type_handle_t memtype = datatype_to_HDF(dtype);
+    if (!memtype.valid()) {
+        warning("h5_append: Unsupported image type.");
+        return false;
+    }
+
+    file_handle_t file = open_file(filename, H5F_ACC_RDWR);
+    if (!file.valid()) {
+        warning("h5_append: Can't open file '%s'.", filename);
+        return false;
+    }
+
+    // The dataset stays open, so appending a frame doesn't read its metadata again
+    dataset_handle_t data = open_cached_dataset(file.get(), loc_name.c_str());
+    if (!data.valid()) {
+        warning("h5_append: Invalid location '%s'.", loc_name.c_str());
+        return false;
+    }
+
+    space_handle_t space(H5Dget_space(data.get()));
+    std::vector<hsize_t> dims;
+    int rank = space.valid() ? hsize_array_from_HDF5(space.get(), dims) : -1;
+    if (rank < 2) {
+        warning("h5_append: '%s' is not an appendable dataset.", loc_name.c_str());
+        return false;
+    }
+
+    // Data is a single frame, or a stack of frames along its last (DM) dimension
+    int image_rank = int(counts.size());
+    std::vector<hsize_t> count(rank, 1);
+    for (int n = 0; n < image_rank && n < rank; ++n)
+        count[rank - 1 - n] = counts[image_rank - 1 - n];
+    bool valid = image_rank == rank - 1 || image_rank == rank;
+    for (int n = 1; n < rank; ++n)
+        valid = valid && count[n] == dims[n];
+    if (!valid) {
+        warning("h5_append: Image size doesn't match frame size of dataset.");
+        return false;
+    }
+
+    std::vector<hsize_t> offset(rank, 0);
+    offset[0] = dims[0];
+    dims[0] += count[0];
+    if (H5Dset_extent(data.get(), &dims[0]) < 0) {
+        warning("h5_append: Extending dataset failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    space.reset(H5Dget_space(data.get()));
+    if (!space.valid() || H5Sselect_hyperslab(space.get(), H5S_SELECT_SET, &offset[0], NULL, &count[0], NULL) < 0) {
+        warning("h5_append: selecting hyperslab failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    space_handle_t memspace(H5Screate_simple(rank, &count[0], NULL));
+    if (!memspace.valid()) {
+        warning("h5_append: creation of dataspace failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    if (H5Dwrite(data.get(), memtype.get(), memspace.get(), space.get(), H5P_DEFAULT, buffer) < 0) {
+        warning("h5_append: Writing of frame failed.");
+        dump_HDF_error_stack();
+        dims[0] = offset[0];
+        H5Dset_extent(data.get(), &dims[0]);
+        return false;
+    }
+
+    flush_file_after_append(file.get());
+    return true;
+}
+
+// Asynchronous h5_append()
+struct append_job_t : public write_job_t
+{
+    long                 dtype;
+    std::vector<hsize_t> counts;
+    std::vector<char>    data;
+
+    append_job_t(const char* filename, const std::string& location) : write_job_t(filename, location) {}
+
+    virtual bool run()
+    {
+        return append_frames(filename.c_str(), location, dtype, counts, data.empty() ? NULL : &data[0]);
+    }
+};
+
+bool h5_append(const char* filename, DM_StringToken location, DM_ImageToken image_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        DM::Image image(image_token);
+        long dtype = image.GetDataType();
+        std::vector<hsize_t> counts = image_dims(image);
         std::string loc_name = to_UTF8(DM::String(location));
-        dataset_handle_t data(H5Dcreate(file.get(), loc_name.c_str(), memtype.get(), space.get(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
-        if (!data.valid()) {
-            warning("h5_create_dataset: Creation of dataset '%s' failed.", loc_name.c_str());
-            dump_HDF_error_stack();
-            return false;
+
+        if (async_writes_enabled()) {
+            std::auto_ptr<append_job_t> job(new append_job_t(filename, loc_name));
+            if (snapshot_image(image, job->data)) {
+                job->dtype = dtype;
+                job->counts = counts;
+                job->size = job->data.size();
+                queue_write(job.release());
+                return true;
+            }
         }
 
+        library_lock_t lock(filename);
+        PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_WRITE
+                                               | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+        result = append_frames(filename, loc_name, dtype, counts, imageLock.get());
+
     PLUG_IN_EXIT
 
-    return true;
+    return result;
 }
 
 DM_ImageToken_1Ref h5_read_dataset_all(const char* filename, DM_StringToken location)
@@ -118,14 +717,15 @@ DM_ImageToken_1Ref h5_read_dataset_all(const char* filename, DM_StringToken loca
 
     PLUG_IN_ENTRY
 
-        file_handle_t file(H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT));
+        library_lock_t lock(filename);
+        file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
         if (!file.valid()) {
             warning("h5_read_dataset: Can't open file '%s'.", filename);
             return NULL;
         }
 
         std::string loc_name = to_UTF8(DM::String(location));
-        dataset_handle_t data(H5Oopen(file.get(), loc_name.c_str(), H5P_DEFAULT));
+        dataset_handle_t data = open_dataset(file.get(), loc_name.c_str());
         if (!data.valid()) {
             warning("h5_read_dataset: Invalid location '%s'.", loc_name.c_str());
             return NULL;
@@ -159,11 +759,17 @@ DM_ImageToken_1Ref h5_read_dataset_all(const char* filename, DM_StringToken loca
         }
 
         type_handle_t memtype = datatype_to_HDF(dtype);
-        herr_t err;
+        hsize_t nbytes = H5Tget_size(memtype.get());
+        for (std::vector<hsize_t>::const_iterator it = dims.begin(); it != dims.end(); ++it)
+            nbytes *= *it;
+
+        herr_t err = 0;
         {
             PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_READ
                                                    | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
-            err = H5Dread(data.get(), memtype.get(), H5S_ALL, H5S_ALL, H5P_DEFAULT, imageLock.get());
+            if (!read_contiguous_direct(data.get(), memtype.get(), imageLock.get(), nbytes)
+                && !read_chunks_parallel(data.get(), memtype.get(), NULL, NULL, NULL, imageLock.get()))
+                err = H5Dread(data.get(), memtype.get(), H5S_ALL, H5S_ALL, H5P_DEFAULT, imageLock.get());
             image.DataChanged();
         }
         if (err < 0) {
@@ -177,17 +783,158 @@ DM_ImageToken_1Ref h5_read_dataset_all(const char* filename, DM_StringToken loca
     return image.release();
 }
 
-DM::Image do_read_dataset_slice(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, 
-                                unsigned memrank, const hsize_t* dims, const hsize_t* counts, const hsize_t* strides)
+/**
+ * Reads offsets of a slice.
+ * @param func Name of calling function for warnings.
+ * @param offset_token Tag list with offsets (DM order).
+ * @param offset OUT: Offsets (HDF5 order).
+ * @returns Whether succeeded.
+ */
+static bool offsets_from_taglist(const char* func, DM_TagGroupToken offset_token, std::vector<hsize_t>& offset)
 {
-    file_handle_t file(H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT));
-    if (!file.valid()) {
-        warning("h5_read_dataset_slice: Can't open file '%s'.", filename);
-        return DM::Image();
-    }
+    DM::TagGroup offset_tags(offset_token);
+    if (!offset_tags.IsValid() || !offset_tags.IsList()) {
+        warning("%s: offsets must be tag list.", func);
+        return false;
+    }
+
+    offset = hsize_array_from_taglist(offset_tags);
+    return true;
+}
+
+/**
+ * Selects hyperslab of a slice in the data space of a dataset.
+ * @param func Name of calling function for warnings.
+ * @param space_id Data space of dataset.
+ * @param offset Offsets of slice (HDF5 order).
+ * @param memrank Rank of slice.
+ * @param dims, counts, strides Dimension of dataset (DM numbering), number and distance of elements 
+ *        for each dimension of the slice (HDF5 order).
+ * @param select_stride, select_count OUT: Selected hyperslab (HDF5 order).
+ * @param blocks Number of adjacent elements per block for each dimension of the slice (HDF5 order),
+ *        NULL for single elements.
+ * @returns Whether succeeded.
+ */
+static bool select_slice(const char* func, hid_t space_id, const std::vector<hsize_t>& offset,
+                         unsigned memrank, const hsize_t* dims, const hsize_t* counts, const hsize_t* strides,
+                         std::vector<hsize_t>& select_stride, std::vector<hsize_t>& select_count,
+                         const hsize_t* blocks = NULL)
+{
+    int rank = H5Sis_simple(space_id) ? H5Sget_simple_extent_ndims(space_id) : -1;
+    if (rank < 0) {
+        warning("%s: Unsupported data space.", func);
+        return false;
+    }
+
+    if (offset.size() != rank) {
+        warning("%s: invalid size of offsets list, expected: %d.", func, rank);
+        return false;
+    }
+
+    // Select hyperslab (reverse dimensions, DM uses column major, HDF5 row major)
+    select_count.assign(rank, 1);
+    select_stride.assign(rank, 1);
+    std::vector<hsize_t> select_block(rank, 1);
+    hsize_t last_dim = rank;
+    for (unsigned n = 0; n < memrank; ++n) {
+        if (dims[n] < 0 || dims[n] >= rank) {
+            warning("%s: Invalid dimension %d, dataset rank is %d.", func, dims[n], rank);
+            return false;
+        }
+        if (dims[n] >= last_dim) {
+            warning("%s: Dimensions must be in increasing order.", func);
+            return false;
+        }
+        last_dim = dims[n];
+
+        unsigned index = rank - 1 - unsigned(dims[n]);
+        select_count[index] = counts[n];
+        select_stride[index] = strides[n];
+        if (blocks)
+            select_block[index] = blocks[n];
+    }
+    if (H5Sselect_hyperslab(space_id, H5S_SELECT_SET, &offset[0], &select_stride[0], &select_count[0], &select_block[0]) < 0) {
+        warning("%s: selecting hyperslab failed.", func);
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Last slice read by do_read_dataset_slice(), to detect that a dataset is read frame by frame.
+ */
+struct slice_history_t
+{
+    std::string          key;       // File and dataset
+    std::vector<hsize_t> offset;
+    std::vector<hsize_t> stride;
+    std::vector<hsize_t> count;
+    std::vector<hsize_t> step;      // Distance from previous slice, empty if none
+};
+
+static slice_history_t last_slice;
+
+/**
+ * Starts readahead of the following slices, if the last three slices read from the dataset
+ * had equal extents and advanced by the same step along a single dimension.
+ * @param offset, stride, count Slice just read (HDF5 order).
+ */
+static void readahead_if_sequential(hid_t dset_id, const char* filename, const std::string& loc_name, const std::vector<hsize_t>& offset, 
+                                    const std::vector<hsize_t>& stride, const std::vector<hsize_t>& count)
+{
+    std::string key = normalize_path(filename) + '\n' + loc_name;
+    bool same = key == last_slice.key && stride == last_slice.stride && count == last_slice.count;
+
+    std::vector<hsize_t> step(offset.size(), 0);
+    int num_steps = 0;
+    for (std::size_t n = 0; same && n < offset.size(); ++n) {
+        if (offset[n] < last_slice.offset[n])
+            same = false;
+        else if (offset[n] > last_slice.offset[n]) {
+            step[n] = offset[n] - last_slice.offset[n];
+            ++num_steps;
+        }
+    }
+    bool sequential = same && num_steps == 1 && step == last_slice.step;
+
+    last_slice.key = key;
+    last_slice.offset = offset;
+    last_slice.stride = stride;
+    last_slice.count = count;
+    if (same && num_steps == 1)
+        last_slice.step = step;
+    else
+        last_slice.step.clear();
+
+    if (sequential)
+        readahead_chunks(dset_id, filename, loc_name, &offset[0], &stride[0], &count[0], &step[0]);
+}
+
+/**
+ * Reads slice of a dataset.
+ * @param offset_token Tag list with offsets (DM order).
+ * @param dims, counts, strides, blocks See select_slice().
+ * @returns Image with extent count * block for each dimension, invalid image on failure.
+ */
+DM::Image do_read_dataset_slice(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, 
+                                unsigned memrank, const hsize_t* dims, const hsize_t* counts, const hsize_t* strides,
+                                const hsize_t* blocks = NULL)
+{
+    std::vector<hsize_t> offset;
+    if (!offsets_from_taglist("h5_read_dataset_slice", offset_token, offset))
+        return DM::Image();
+
+    library_lock_t lock(filename);
+    file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
+    if (!file.valid()) {
+        warning("h5_read_dataset_slice: Can't open file '%s'.", filename);
+        return DM::Image();
+    }
 
     std::string loc_name = to_UTF8(DM::String(location));
-    dataset_handle_t data(H5Oopen(file.get(), loc_name.c_str(), H5P_DEFAULT));
+    dataset_handle_t data = open_dataset(file.get(), loc_name.c_str());
     if (!data.valid()) {
         warning("h5_read_dataset_slice: Invalid location '%s'.", loc_name.c_str());
         return DM::Image();
@@ -208,69 +955,45 @@ DM::Image do_read_dataset_slice(const char* filename, DM_StringToken location, D
     }
 
     long dtype = datatype_from_HDF(type.get());
-    int rank = H5Sis_simple(space.get()) ? H5Sget_simple_extent_ndims(space.get()) : -1;
-    if (rank < 0 || dtype < 0) {
-        warning("h5_read_dataset_slice: Unsupported array type or data space.");
+    if (dtype < 0) {
+        warning("h5_read_dataset_slice: Unsupported array type.");
         return DM::Image();
     }
 
-    // Get and check offsets
-    DM::TagGroup offset_tags(offset_token);
-    if (!offset_tags.IsValid() || !offset_tags.IsList()) {
-        warning("h5_read_dataset_slice: offsets must be tag list.");
-        return DM::Image();
-    }
-    std::vector<hsize_t> offset = hsize_array_from_taglist(offset_tags);
-    if (offset.size() != rank) {
-        warning("h5_read_dataset_slice: invalid size of offsets list, expected: %d.", rank);
+    std::vector<hsize_t> select_stride, select_count;
+    if (!select_slice("h5_read_dataset_slice", space.get(), offset, memrank, dims, counts, strides, select_stride, select_count, blocks))
         return DM::Image();
-    }
-
-    // Select hyperslab (reverse dimensions, DM uses column major, HDF5 row major)
-    std::vector<hsize_t> select_count(rank, 1);
-    std::vector<hsize_t> select_stride(rank, 1);
-    hsize_t last_dim = rank;
-    for (unsigned n = 0; n < memrank; ++n) {
-        if (dims[n] < 0 || dims[n] >= rank) {
-            warning("h5_read_dataset_slice: Invalid dimension %d, dataset rank is %d.", dims[n], rank);
-            return DM::Image();
-        }
-        if (dims[n] >= last_dim) {
-            warning("h5_read_dataset_slice: Dimensions must be in increasing order.");
-            return DM::Image();
-        }
-        last_dim = dims[n];
 
-        unsigned index = rank - 1 - unsigned(dims[n]);
-        select_count[index] = counts[n];
-        select_stride[index] = strides[n];
-    }
-    if (H5Sselect_hyperslab(space.get(), H5S_SELECT_SET, &offset[0], &select_stride[0], &select_count[0], NULL) < 0) {
-        warning("h5_read_dataset_slice: selecting hyperslab failed.");
-        dump_HDF_error_stack();
-        return DM::Image();
+    // Blocks of a dimension are contiguous in memory
+    std::vector<hsize_t> extent(counts, counts + memrank);
+    bool blocked = false;
+    for (unsigned n = 0; blocks && n < memrank; ++n) {
+        extent[n] *= blocks[n];
+        blocked |= blocks[n] != 1;
     }
 
     // Create memory data space
-    space_handle_t memspace(H5Screate_simple(memrank, counts, NULL));
+    space_handle_t memspace(H5Screate_simple(memrank, &extent[0], NULL));
     if (!memspace.valid()) {
         warning("h5_read_dataset_slice: creation of dataspace failed.");
         dump_HDF_error_stack();
         return DM::Image();
     }
 
-    DM::Image image = create_image(dtype, memrank, counts);
+    DM::Image image = create_image(dtype, memrank, &extent[0]);
     if (!image.IsValid()) {
         warning("h5_read_dataset_slice: Can't create image.");
         return DM::Image();
     }
 
     type_handle_t memtype = datatype_to_HDF(dtype);
-    herr_t err;
+    herr_t err = 0;
     {
         PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_READ
                                                | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
-        err = H5Dread(data.get(), memtype.get(), memspace.get(), space.get(), H5P_DEFAULT, imageLock.get());
+        // Parallel reading and readahead only know single element selections
+        if (blocked || !read_chunks_parallel(data.get(), memtype.get(), &offset[0], &select_stride[0], &select_count[0], imageLock.get()))
+            err = H5Dread(data.get(), memtype.get(), memspace.get(), space.get(), H5P_DEFAULT, imageLock.get());
         image.DataChanged();
     }
     if (err < 0) {
@@ -279,9 +1002,90 @@ DM::Image do_read_dataset_slice(const char* filename, DM_StringToken location, D
         return DM::Image();
     }
 
+    if (!blocked)
+        readahead_if_sequential(data.get(), filename, loc_name, offset, select_stride, select_count);
     return image;
 }
 
+/**
+ * Reads one value per slice dimension from a tag list.
+ * @param func Name of calling function for warnings.
+ * @param name Name of the list for warnings.
+ * @param token Tag list (DM order).
+ * @param memrank Rank of slice, 0 if not yet known.
+ * @param values OUT: Values (HDF5 order).
+ * @returns Whether succeeded.
+ */
+static bool slice_list_from_taglist(const char* func, const char* name, DM_TagGroupToken token, unsigned& memrank, std::vector<hsize_t>& values)
+{
+    DM::TagGroup tags(token);
+    if (!tags.IsValid() || !tags.IsList()) {
+        warning("%s: %s must be tag list.", func, name);
+        return false;
+    }
+
+    values = hsize_array_from_taglist(tags);
+    if (memrank == 0) {
+        if (values.empty() || values.size() > 4) {
+            warning("%s: Slice must have 1 to 4 dimensions.", func);
+            return false;
+        }
+        memrank = unsigned(values.size());
+    } else if (values.size() != memrank) {
+        warning("%s: invalid size of %s list, expected: %u.", func, name, memrank);
+        return false;
+    }
+
+    return true;
+}
+
+static DM::Image do_read_dataset_slice_lists(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_TagGroupToken dims_token,
+                                             DM_TagGroupToken counts_token, DM_TagGroupToken strides_token, DM_TagGroupToken blocks_token)
+{
+    const char* func = "h5_read_dataset_slice";
+    unsigned memrank = 0;
+    std::vector<hsize_t> dims, counts, strides, blocks;
+    if (!slice_list_from_taglist(func, "dimensions", dims_token, memrank, dims)
+            || !slice_list_from_taglist(func, "counts", counts_token, memrank, counts)
+            || !slice_list_from_taglist(func, "strides", strides_token, memrank, strides))
+        return DM::Image();
+
+    // Blocks are optional
+    if (blocks_token && !slice_list_from_taglist(func, "blocks", blocks_token, memrank, blocks))
+        return DM::Image();
+
+    return do_read_dataset_slice(filename, location, offset_token, memrank, &dims[0], &counts[0], &strides[0],
+                                 blocks.empty() ? NULL : &blocks[0]);
+}
+
+DM_ImageToken_1Ref h5_read_dataset_slice(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_TagGroupToken dims_token,
+                                         DM_TagGroupToken counts_token, DM_TagGroupToken strides_token)
+{
+    DM::Image image;
+
+    PLUG_IN_ENTRY
+
+        image = do_read_dataset_slice_lists(filename, location, offset_token, dims_token, counts_token, strides_token, NULL);
+
+    PLUG_IN_EXIT
+
+    return image.release();
+}
+
+DM_ImageToken_1Ref h5_read_dataset_slice_blocks(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_TagGroupToken dims_token,
+                                                DM_TagGroupToken counts_token, DM_TagGroupToken strides_token, DM_TagGroupToken blocks_token)
+{
+    DM::Image image;
+
+    PLUG_IN_ENTRY
+
+        image = do_read_dataset_slice_lists(filename, location, offset_token, dims_token, counts_token, strides_token, blocks_token);
+
+    PLUG_IN_EXIT
+
+    return image.release();
+}
+
 DM_ImageToken_1Ref h5_read_dataset_slice1(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, long dim0, long count0, long stride0)
 {
     DM::Image image;
@@ -330,20 +1134,784 @@ DM_ImageToken_1Ref h5_read_dataset_slice3(const char* filename, DM_StringToken l
     return image.release();
 }
 
+/**
+ * Reads slice of a dataset into an existing image.
+ * @param dest Destination image, must have type of dataset.
+ * @param dest_offset_token Tag list with position of slice in @p dest (DM order), NULL for origin.
+ * @param offset_token Tag list with offsets (DM order), NULL to read the whole dataset.
+ * @param dims, counts, strides See select_slice(), ignored if @p offset_token is NULL.
+ * @returns Whether succeeded.
+ */
+static bool do_read_dataset_into(const char* filename, DM_StringToken location, DM::Image dest, DM_TagGroupToken dest_offset_token,
+                                 DM_TagGroupToken offset_token, unsigned memrank, const hsize_t* dims, const hsize_t* counts, const hsize_t* strides)
+{
+    const char* func = "h5_read_dataset_into";
+    if (!dest.IsValid()) {
+        warning("%s: Invalid image.", func);
+        return false;
+    }
+
+    std::vector<hsize_t> dest_dims = image_dims(dest);
+    std::vector<hsize_t> dest_offset(dest_dims.size(), 0);
+    if (dest_offset_token) {
+        if (!offsets_from_taglist(func, dest_offset_token, dest_offset))
+            return false;
+        if (dest_offset.size() != dest_dims.size()) {
+            warning("%s: invalid size of destination offsets list, expected: %u.", func, unsigned(dest_dims.size()));
+            return false;
+        }
+    }
+
+    std::vector<hsize_t> offset;
+    if (offset_token && !offsets_from_taglist(func, offset_token, offset))
+        return false;
+
+    library_lock_t lock(filename);
+    file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
+    if (!file.valid()) {
+        warning("%s: Can't open file '%s'.", func, filename);
+        return false;
+    }
+
+    std::string loc_name = to_UTF8(DM::String(location));
+    dataset_handle_t data = open_dataset(file.get(), loc_name.c_str());
+    if (!data.valid()) {
+        warning("%s: Invalid location '%s'.", func, loc_name.c_str());
+        return false;
+    }
+
+    space_handle_t space(H5Dget_space(data.get()));
+    type_handle_t type(H5Dget_type(data.get()));
+    if (!space.valid() || !type.valid()) {
+        warning("%s: Reading data space or type failed.", func);
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    long dtype = datatype_from_HDF(type.get());
+    if (dtype < 0) {
+        warning("%s: Unsupported array type.", func);
+        return false;
+    }
+    if (dtype != dest.GetDataType()) {
+        warning("%s: Image must have data type %ld of dataset.", func, dtype);
+        return false;
+    }
+
+    // Without offsets the whole dataset is read
+    std::vector<hsize_t> all_dims, all_strides, all_counts;
+    if (!offset_token) {
+        if (hsize_array_from_HDF5(space.get(), all_counts) < 0) {
+            warning("%s: Unsupported data space.", func);
+            return false;
+        }
+        memrank = unsigned(all_counts.size());
+        if (memrank == 0) {
+            warning("%s: Scalar datasets are not supported.", func);
+            return false;
+        }
+        offset.assign(memrank, 0);
+        all_strides.assign(memrank, 1);
+        for (unsigned n = 0; n < memrank; ++n)
+            all_dims.push_back(memrank - 1 - n);
+        dims = all_dims.empty() ? NULL : &all_dims[0];
+        counts = all_counts.empty() ? NULL : &all_counts[0];
+        strides = all_strides.empty() ? NULL : &all_strides[0];
+    }
+
+    std::vector<hsize_t> select_stride, select_count;
+    if (!select_slice(func, space.get(), offset, memrank, dims, counts, strides, select_stride, select_count))
+        return false;
+
+    // Slice fills the first dimensions of the image (the last in HDF5 order)
+    unsigned dest_rank = unsigned(dest_dims.size());
+    if (memrank > dest_rank) {
+        warning("%s: Image must have at least %u dimensions.", func, memrank);
+        return false;
+    }
+    std::vector<hsize_t> dest_count(dest_rank, 1);
+    std::copy(counts, counts + memrank, dest_count.begin() + (dest_rank - memrank));
+    for (unsigned n = 0; n < dest_rank; ++n)
+        if (dest_offset[n] + dest_count[n] > dest_dims[n]) {
+            warning("%s: Slice exceeds image in dimension %u.", func, dest_rank - 1 - n);
+            return false;
+        }
+
+    // Region of image is contiguous, if it spans all inner dimensions
+    bool contiguous = true;
+    unsigned partial = 0;
+    while (partial < dest_rank && dest_count[partial] == 1)
+        ++partial;
+    for (unsigned n = partial + 1; n < dest_rank; ++n)
+        contiguous &= dest_offset[n] == 0 && dest_count[n] == dest_dims[n];
+
+    bool whole = contiguous;
+    hsize_t start = 0;
+    for (unsigned n = 0; n < dest_rank; ++n) {
+        start = start * dest_dims[n] + dest_offset[n];
+        whole &= dest_count[n] == dest_dims[n];
+    }
+
+    type_handle_t memtype = datatype_to_HDF(dtype);
+    herr_t err = 0;
+    {
+        PlugIn::ImageDataLocker imageLock(dest, (whole ? PlugIn::ImageDataLocker::lock_data_WONT_READ : 0)
+                                              | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+        char* buffer = static_cast<char*>(imageLock.get());
+        if (contiguous) {
+            buffer += start * H5Tget_size(memtype.get());
+            if (!read_chunks_parallel(data.get(), memtype.get(), &offset[0], &select_stride[0], &select_count[0], buffer)) {
+                space_handle_t memspace(H5Screate_simple(memrank, counts, NULL));
+                err = memspace.valid() ? H5Dread(data.get(), memtype.get(), memspace.get(), space.get(), H5P_DEFAULT, buffer) : -1;
+            }
+        } else {
+            space_handle_t memspace(H5Screate_simple(dest_rank, &dest_dims[0], NULL));
+            if (!memspace.valid() || H5Sselect_hyperslab(memspace.get(), H5S_SELECT_SET, &dest_offset[0], NULL, &dest_count[0], NULL) < 0)
+                err = -1;
+            else
+                err = H5Dread(data.get(), memtype.get(), memspace.get(), space.get(), H5P_DEFAULT, buffer);
+        }
+        dest.DataChanged();
+    }
+    if (err < 0) {
+        warning("%s: Reading of dataset failed.", func);
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    readahead_if_sequential(data.get(), filename, loc_name, offset, select_stride, select_count);
+    return true;
+}
+
+bool h5_read_dataset_into(const char* filename, DM_StringToken location, DM_ImageToken image_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        result = do_read_dataset_into(filename, location, DM::Image(image_token), NULL, NULL, 0, NULL, NULL, NULL);
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+bool h5_read_dataset_into_offset(const char* filename, DM_StringToken location, DM_ImageToken image_token, DM_TagGroupToken dest_offset_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        result = do_read_dataset_into(filename, location, DM::Image(image_token), dest_offset_token, NULL, 0, NULL, NULL, NULL);
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+bool h5_read_dataset_slice_into(const char* filename, DM_StringToken location, DM_ImageToken image_token, DM_TagGroupToken dest_offset_token,
+                                DM_TagGroupToken offset_token, DM_TagGroupToken dims_token, DM_TagGroupToken counts_token, DM_TagGroupToken strides_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        const char* func = "h5_read_dataset_into";
+        unsigned memrank = 0;
+        std::vector<hsize_t> dims, counts, strides;
+        if (slice_list_from_taglist(func, "dimensions", dims_token, memrank, dims)
+                && slice_list_from_taglist(func, "counts", counts_token, memrank, counts)
+                && slice_list_from_taglist(func, "strides", strides_token, memrank, strides))
+            result = do_read_dataset_into(filename, location, DM::Image(image_token), dest_offset_token, offset_token,
+                                          memrank, &dims[0], &counts[0], &strides[0]);
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+// Bytes of a dataset read at once by h5_read_dataset_binned()
+static const hsize_t max_band_bytes = 64 * 1024 * 1024;
+
+/**
+ * Reads slice of a dataset, reducing bins of elements to their sum or mean. The slice is
+ * read in bands of whole bins, so only the binned image must fit into memory.
+ * @param offset_token Tag list with offsets (DM order).
+ * @param dims, counts, bins Dimensions of dataset (DM numbering), number of bins and elements
+ *        per bin for each dimension of the slice (HDF5 order).
+ * @param mean Whether the mean instead of the sum of the bins is returned.
+ * @returns Image with extent @p counts, invalid image on failure.
+ */
+static DM::Image do_read_dataset_binned(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token,
+                                        unsigned memrank, const hsize_t* dims, const hsize_t* counts, const hsize_t* bins, bool mean)
+{
+    const char* func = "h5_read_dataset_binned";
+    std::vector<hsize_t> offset;
+    if (!offsets_from_taglist(func, offset_token, offset))
+        return DM::Image();
+
+    library_lock_t lock(filename);
+    file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
+    if (!file.valid()) {
+        warning("%s: Can't open file '%s'.", func, filename);
+        return DM::Image();
+    }
+
+    std::string loc_name = to_UTF8(DM::String(location));
+    dataset_handle_t data = open_dataset(file.get(), loc_name.c_str());
+    if (!data.valid()) {
+        warning("%s: Invalid location '%s'.", func, loc_name.c_str());
+        return DM::Image();
+    }
+
+    space_handle_t space(H5Dget_space(data.get()));
+    type_handle_t type(H5Dget_type(data.get()));
+    if (!space.valid() || !type.valid()) {
+        warning("%s: Reading data space or type failed.", func);
+        dump_HDF_error_stack();
+        return DM::Image();
+    }
+
+    long dtype = datatype_from_HDF(type.get());
+    long out_dtype = binned_datatype(dtype, mean);
+    if (out_dtype < 0) {
+        warning("%s: Unsupported array type.", func);
+        return DM::Image();
+    }
+
+    // Extents of slice and bins padded to 4 dimensions
+    hsize_t in_dims[4] = { 1, 1, 1, 1 }, bin_dims[4] = { 1, 1, 1, 1 };
+    hsize_t bin_size = 1;
+    for (unsigned n = 0; n < memrank; ++n) {
+        if (bins[n] == 0 || counts[n] == 0) {
+            warning("%s: Counts and bins must be > 0.", func);
+            return DM::Image();
+        }
+        in_dims[4 - memrank + n] = counts[n] * bins[n];
+        bin_dims[4 - memrank + n] = bins[n];
+        bin_size *= bins[n];
+    }
+
+    DM::Image image = create_image(out_dtype, memrank, counts);
+    if (!image.IsValid()) {
+        warning("%s: Can't create image.", func);
+        return DM::Image();
+    }
+
+    // Bands span whole bins of the outermost dimension of the slice
+    type_handle_t memtype = datatype_to_HDF(dtype);
+    std::size_t elem_size = H5Tget_size(memtype.get());
+    hsize_t row_bytes = elem_size * bins[0];
+    for (unsigned n = 1; n < memrank; ++n)
+        row_bytes *= in_dims[4 - memrank + n];
+    hsize_t band_rows = std::max<hsize_t>(1, std::min<hsize_t>(counts[0], max_band_bytes / row_bytes));
+    std::size_t row_elems = 1;
+    for (unsigned n = 1; n < memrank; ++n)
+        row_elems *= std::size_t(counts[n]);
+
+    std::vector<hsize_t> band_counts(counts, counts + memrank), band_strides(memrank, 1);
+    std::vector<char> band;
+    binning_acc_t acc;
+    unsigned band_index = unsigned(H5Sget_simple_extent_ndims(space.get()) - 1) - unsigned(dims[0]);
+    herr_t err = 0;
+    {
+        PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_READ
+                                               | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+        char* output = static_cast<char*>(imageLock.get());
+        std::size_t out_elem_size = DM::ImageGetDataElementByteSize(image);
+
+        for (hsize_t row = 0; row < counts[0] && err >= 0; row += band_rows) {
+            hsize_t rows = std::min(band_rows, counts[0] - row);
+            std::vector<hsize_t> band_offset(offset);
+            if (band_index < band_offset.size())
+                band_offset[band_index] += row * bins[0];
+            for (unsigned n = 0; n < memrank; ++n)
+                band_counts[n] = in_dims[4 - memrank + n];
+            band_counts[0] = rows * bins[0];
+
+            std::vector<hsize_t> select_stride, select_count;
+            if (!select_slice(func, space.get(), band_offset, memrank, dims, &band_counts[0], &band_strides[0], select_stride, select_count))
+                return DM::Image();
+
+            hsize_t band_elems = 1;
+            for (unsigned n = 0; n < memrank; ++n)
+                band_elems *= band_counts[n];
+            band.resize(std::size_t(band_elems * elem_size));
+
+            // Bands are streamed through once, so they bypass the decoded chunk cache
+            if (!read_chunks_parallel(data.get(), memtype.get(), &band_offset[0], &select_stride[0], &select_count[0], &band[0], false)) {
+                space_handle_t memspace(H5Screate_simple(memrank, &band_counts[0], NULL));
+                err = memspace.valid() ? H5Dread(data.get(), memtype.get(), memspace.get(), space.get(), H5P_DEFAULT, &band[0]) : -1;
+                if (err < 0)
+                    break;
+            }
+
+            // Reduce band to output rows
+            hsize_t band_dims[4] = { in_dims[0], in_dims[1], in_dims[2], in_dims[3] };
+            band_dims[4 - memrank] = rows * bins[0];
+            reset_binning_acc(dtype, std::size_t(rows) * row_elems, acc);
+            bin_elements(dtype, &band[0], band_dims, bin_dims, acc);
+            store_binned(dtype, acc, mean ? double(bin_size) : 0.0, out_dtype,
+                         output + std::size_t(row) * row_elems * out_elem_size);
+        }
+        image.DataChanged();
+    }
+    if (err < 0) {
+        warning("%s: Reading of dataset failed.", func);
+        dump_HDF_error_stack();
+        return DM::Image();
+    }
+
+    return image;
+}
+
+DM_ImageToken_1Ref h5_read_dataset_binned(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_TagGroupToken dims_token,
+                                          DM_TagGroupToken counts_token, DM_TagGroupToken bins_token, const char* mode)
+{
+    DM::Image image;
+
+    PLUG_IN_ENTRY
+
+        const char* func = "h5_read_dataset_binned";
+        unsigned memrank = 0;
+        std::vector<hsize_t> dims, counts, bins;
+        bool mean = _stricmp(mode, "mean") == 0;
+        if (!mean && _stricmp(mode, "sum") != 0)
+            warning("%s: Unknown mode '%s', must be \"Sum\" or \"Mean\".", func, mode);
+        else if (slice_list_from_taglist(func, "dimensions", dims_token, memrank, dims)
+                && slice_list_from_taglist(func, "counts", counts_token, memrank, counts)
+                && slice_list_from_taglist(func, "bins", bins_token, memrank, bins))
+            image = do_read_dataset_binned(filename, location, offset_token, memrank, &dims[0], &counts[0], &bins[0], mean);
+
+    PLUG_IN_EXIT
+
+    return image.release();
+}
+
+// Orders points by chunk, then by position in dataset
+struct point_order_t
+{
+    const std::vector<hsize_t>& coords;
+    const std::vector<hsize_t>& chunk;
+
+    point_order_t(const std::vector<hsize_t>& _coords, const std::vector<hsize_t>& _chunk)
+    : coords(_coords), chunk(_chunk) {}
+
+    bool operator()(std::size_t a, std::size_t b) const
+    {
+        std::size_t rank = chunk.size();
+        const hsize_t* pa = &coords[a * rank];
+        const hsize_t* pb = &coords[b * rank];
+        for (std::size_t n = 0; n < rank; ++n)
+            if (pa[n] / chunk[n] != pb[n] / chunk[n])
+                return pa[n] / chunk[n] < pb[n] / chunk[n];
+        return std::lexicographical_compare(pa, pa + rank, pb, pb + rank);
+    }
+};
+
+/**
+ * Reads scattered elements of a dataset with one element selection.
+ * @param coords Coordinates of points (HDF5 order), @p point_rank values per point.
+ * @param point_rank Coordinates per point, must be rank of dataset.
+ * @param out_rank, out_dims Extent of returned image (HDF5 order), must hold all points.
+ * @returns Image with elements in order of @p coords, invalid image on failure.
+ */
+static DM::Image do_read_dataset_points(const char* filename, DM_StringToken location, const std::vector<hsize_t>& coords,
+                                        std::size_t point_rank, int out_rank, const hsize_t* out_dims)
+{
+    const char* func = "h5_read_dataset_points";
+    library_lock_t lock(filename);
+    file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
+    if (!file.valid()) {
+        warning("%s: Can't open file '%s'.", func, filename);
+        return DM::Image();
+    }
+
+    std::string loc_name = to_UTF8(DM::String(location));
+    dataset_handle_t data = open_dataset(file.get(), loc_name.c_str());
+    if (!data.valid()) {
+        warning("%s: Invalid location '%s'.", func, loc_name.c_str());
+        return DM::Image();
+    }
+
+    space_handle_t space(H5Dget_space(data.get()));
+    type_handle_t type(H5Dget_type(data.get()));
+    std::vector<hsize_t> dims;
+    if (!space.valid() || !type.valid() || hsize_array_from_HDF5(space.get(), dims) <= 0) {
+        warning("%s: Reading data space or type failed.", func);
+        dump_HDF_error_stack();
+        return DM::Image();
+    }
+
+    long dtype = datatype_from_HDF(type.get());
+    if (dtype < 0) {
+        warning("%s: Unsupported array type.", func);
+        return DM::Image();
+    }
+
+    std::size_t rank = dims.size();
+    if (point_rank != rank) {
+        warning("%s: Each point must have %u coordinates.", func, unsigned(rank));
+        return DM::Image();
+    }
+    std::size_t num_points = coords.size() / rank;
+    if (num_points == 0) {
+        warning("%s: No points given.", func);
+        return DM::Image();
+    }
+    for (std::size_t n = 0; n < coords.size(); ++n)
+        if (coords[n] >= dims[n % rank]) {
+            warning("%s: Point %u outside of dataset.", func, unsigned(n / rank));
+            return DM::Image();
+        }
+
+    // Points of one chunk are adjacent, so every chunk is decompressed once
+    std::vector<hsize_t> chunk(rank, 1);
+    plist_handle_t dcpl(H5Dget_create_plist(data.get()));
+    if (dcpl.valid() && H5Pget_layout(dcpl.get()) == H5D_CHUNKED)
+        H5Pget_chunk(dcpl.get(), int(rank), &chunk[0]);
+    std::vector<std::size_t> order(num_points);
+    for (std::size_t n = 0; n < num_points; ++n)
+        order[n] = n;
+    std::sort(order.begin(), order.end(), point_order_t(coords, chunk));
+
+    std::vector<hsize_t> sorted(coords.size());
+    for (std::size_t n = 0; n < num_points; ++n)
+        std::copy(&coords[order[n] * rank], &coords[order[n] * rank] + rank, &sorted[n * rank]);
+
+    hsize_t num = num_points;
+    space_handle_t memspace(H5Screate_simple(1, &num, NULL));
+    if (!memspace.valid() || H5Sselect_elements(space.get(), H5S_SELECT_SET, num_points, &sorted[0]) < 0) {
+        warning("%s: Selecting points failed.", func);
+        dump_HDF_error_stack();
+        return DM::Image();
+    }
+
+    type_handle_t memtype = datatype_to_HDF(dtype);
+    std::size_t elemsize = H5Tget_size(memtype.get());
+    std::vector<char> values(num_points * elemsize);
+    if (H5Dread(data.get(), memtype.get(), memspace.get(), space.get(), H5P_DEFAULT, &values[0]) < 0) {
+        warning("%s: Reading of dataset failed.", func);
+        dump_HDF_error_stack();
+        return DM::Image();
+    }
+
+    DM::Image image = create_image(dtype, out_rank, out_dims);
+    if (!image.IsValid()) {
+        warning("%s: Can't create image.", func);
+        return DM::Image();
+    }
+
+    {
+        PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_READ
+                                               | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+        char* output = static_cast<char*>(imageLock.get());
+        for (std::size_t n = 0; n < num_points; ++n)
+            memcpy(output + order[n] * elemsize, &values[n * elemsize], elemsize);
+        image.DataChanged();
+    }
+
+    return image;
+}
+
+DM_ImageToken_1Ref h5_read_dataset_points(const char* filename, DM_StringToken location, DM_ImageToken coords_token)
+{
+    DM::Image image;
+
+    PLUG_IN_ENTRY
+
+        // First dimension holds coordinates of a point, the others give the shape of the result
+        DM::Image coords_image(coords_token);
+        int coords_rank = coords_image.IsValid() ? coords_image.GetNumDimensions() : 0;
+        if (coords_rank < 2 || coords_rank > 3) {
+            warning("h5_read_dataset_points: Coordinates must be a 2D or 3D image.");
+            return NULL;
+        }
+
+        std::vector<hsize_t> shape = image_dims(coords_image);
+        std::size_t point_rank = std::size_t(shape.back());
+        shape.pop_back();
+        std::size_t count = point_rank;
+        for (std::size_t n = 0; n < shape.size(); ++n)
+            count *= std::size_t(shape[n]);
+
+        // Convert to double to check for negative numbers and fractions
+        std::vector<double> values(count);
+        {
+            // The conversion uses the library, the lock must outlive coords_type
+            library_lock_t lock;
+            type_handle_t coords_type = datatype_to_HDF(coords_image.GetDataType());
+            if (!coords_type.valid()) {
+                warning("h5_read_dataset_points: Unsupported type of coordinates.");
+                return NULL;
+            }
+
+            PlugIn::ImageDataLocker coordsLock(coords_image, PlugIn::ImageDataLocker::lock_data_WONT_WRITE
+                                                           | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+            std::size_t elemsize = H5Tget_size(coords_type.get());
+            std::vector<char> converted(count * std::max(elemsize, sizeof(double)));
+            memcpy(&converted[0], coordsLock.get(), count * elemsize);
+            if (H5Tconvert(coords_type.get(), H5T_NATIVE_DOUBLE, count, &converted[0], NULL, H5P_DEFAULT) < 0) {
+                warning("h5_read_dataset_points: Unsupported type of coordinates.");
+                return NULL;
+            }
+            memcpy(&values[0], &converted[0], count * sizeof(double));
+        }
+
+        std::vector<hsize_t> coords(count);
+        for (std::size_t n = 0; n < count; ++n) {
+            if (values[n] < 0 || values[n] != floor(values[n])) {
+                warning("h5_read_dataset_points: Coordinates must be non-negative integers.");
+                return NULL;
+            }
+            // Reverse coordinates of each point (DM to HDF5 order)
+            std::size_t point = n / point_rank, index = n % point_rank;
+            coords[point * point_rank + point_rank - 1 - index] = hsize_t(values[n]);
+        }
+
+        image = do_read_dataset_points(filename, location, coords, point_rank, int(shape.size()), &shape[0]);
+
+    PLUG_IN_EXIT
+
+    return image.release();
+}
+
+DM_ImageToken_1Ref h5_read_dataset_points_list(const char* filename, DM_StringToken location, DM_TagGroupToken coords_token)
+{
+    DM::Image image;
+
+    PLUG_IN_ENTRY
+
+        // List of tag lists with the coordinates of each point
+        DM::TagGroup points(coords_token);
+        if (!points.IsValid() || !points.IsList()) {
+            warning("h5_read_dataset_points: Coordinates must be tag list.");
+            return NULL;
+        }
+
+        std::vector<hsize_t> coords;
+        std::size_t point_rank = 0;
+        long num_points = points.CountTags();
+        for (long n = 0; n < num_points; ++n) {
+            DM::TagGroup point;
+            if (!points.GetIndexedTagAsTagGroup(n, &point) || !point.IsList()) {
+                warning("h5_read_dataset_points: Point %ld must be tag list.", n);
+                return NULL;
+            }
+            std::vector<hsize_t> coord = hsize_array_from_taglist(point);
+            if (n > 0 && coord.size() != point_rank) {
+                warning("h5_read_dataset_points: All points must have the same number of coordinates.");
+                return NULL;
+            }
+            point_rank = coord.size();
+            coords.insert(coords.end(), coord.begin(), coord.end());
+        }
+
+        hsize_t shape = hsize_t(num_points);
+        image = do_read_dataset_points(filename, location, coords, point_rank, 1, &shape);
+
+    PLUG_IN_EXIT
+
+    return image.release();
+}
+
+/**
+ * Writes slice of a dataset.
+ * @param offset Offsets of slice (HDF5 order).
+ * @param dims, counts, strides See select_slice().
+ * @param buffer Data of type @p dtype.
+ * @returns Whether succeeded.
+ */
+static bool write_slice(const char* filename, const std::string& loc_name, long dtype, const std::vector<hsize_t>& offset,
+                        unsigned memrank, const hsize_t* dims, const hsize_t* counts, const hsize_t* strides, const void* buffer)
+{
+    type_handle_t memtype = datatype_to_HDF(dtype);
+    if (!memtype.valid()) {
+        warning("h5_write_dataset_slice: Unsupported image type.");
+        return false;
+    }
+
+    file_handle_t file = open_file(filename, H5F_ACC_RDWR);
+    if (!file.valid()) {
+        warning("h5_write_dataset_slice: Can't open file '%s'.", filename);
+        return false;
+    }
+
+    // Tiles are usually written one after the other, so keep dataset open
+    dataset_handle_t data = open_cached_dataset(file.get(), loc_name.c_str());
+    if (!data.valid()) {
+        warning("h5_write_dataset_slice: Invalid location '%s'.", loc_name.c_str());
+        return false;
+    }
+
+    space_handle_t space(H5Dget_space(data.get()));
+    if (!space.valid()) {
+        warning("h5_write_dataset_slice: Reading data space failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    std::vector<hsize_t> select_stride, select_count;
+    if (!select_slice("h5_write_dataset_slice", space.get(), offset, memrank, dims, counts, strides, select_stride, select_count))
+        return false;
+
+    if (H5Sselect_valid(space.get()) <= 0) {
+        warning("h5_write_dataset_slice: Slice exceeds dataset.");
+        return false;
+    }
+
+    space_handle_t memspace(H5Screate_simple(memrank, counts, NULL));
+    if (!memspace.valid()) {
+        warning("h5_write_dataset_slice: creation of dataspace failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    if (H5Dwrite(data.get(), memtype.get(), memspace.get(), space.get(), H5P_DEFAULT, buffer) < 0) {
+        warning("h5_write_dataset_slice: Writing of dataset failed.");
+        dump_HDF_error_stack();
+        return false;
+    }
+
+    flush_file(file.get());
+    return true;
+}
+
+// Asynchronous h5_write_dataset_slice()
+struct write_slice_job_t : public write_job_t
+{
+    long                 dtype;
+    std::vector<hsize_t> offset;
+    std::vector<hsize_t> dims;
+    std::vector<hsize_t> counts;
+    std::vector<hsize_t> strides;
+    std::vector<char>    data;
+
+    write_slice_job_t(const char* filename, const std::string& location) : write_job_t(filename, location) {}
+
+    virtual bool run()
+    {
+        return write_slice(filename.c_str(), location, dtype, offset, unsigned(counts.size()), &dims[0], &counts[0], &strides[0], 
+                           data.empty() ? NULL : &data[0]);
+    }
+};
+
+static bool do_write_dataset_slice(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM::Image image,
+                                   unsigned memrank, const hsize_t* dims, const hsize_t* strides)
+{
+    // Extents of slice are given by image
+    if (DM::ImageGetNumDimensions(image) != memrank) {
+        warning("h5_write_dataset_slice: Image must have %d dimensions.", memrank);
+        return false;
+    }
+    std::vector<hsize_t> counts = image_dims(image);
+
+    std::vector<hsize_t> offset;
+    if (!offsets_from_taglist("h5_write_dataset_slice", offset_token, offset))
+        return false;
+
+    long dtype = image.GetDataType();
+    std::string loc_name = to_UTF8(DM::String(location));
+
+    if (async_writes_enabled()) {
+        std::auto_ptr<write_slice_job_t> job(new write_slice_job_t(filename, loc_name));
+        if (snapshot_image(image, job->data)) {
+            job->dtype = dtype;
+            job->offset = offset;
+            job->dims.assign(dims, dims + memrank);
+            job->counts = counts;
+            job->strides.assign(strides, strides + memrank);
+            job->size = job->data.size();
+            queue_write(job.release());
+            return true;
+        }
+    }
+
+    library_lock_t lock(filename);
+    PlugIn::ImageDataLocker imageLock(image, PlugIn::ImageDataLocker::lock_data_WONT_WRITE
+                                           | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+    return write_slice(filename, loc_name, dtype, offset, memrank, dims, &counts[0], strides, imageLock.get());
+}
+
+bool h5_write_dataset_slice(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_ImageToken image_token)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        // Image dimensions are the first dimensions of the dataset
+        DM::Image image(image_token);
+        unsigned memrank = DM::ImageGetNumDimensions(image);
+        std::vector<hsize_t> dims(memrank), strides(memrank, 1);
+        for (unsigned n = 0; n < memrank; ++n)
+            dims[n] = memrank - 1 - n;
+        result = do_write_dataset_slice(filename, location, offset_token, image, memrank, dims.empty() ? NULL : &dims[0], strides.empty() ? NULL : &strides[0]);
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+bool h5_write_dataset_slice1(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_ImageToken image_token, long dim0, long stride0)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        hsize_t dims[1] = { dim0 };
+        hsize_t strides[1] = { stride0 };
+        result = do_write_dataset_slice(filename, location, offset_token, DM::Image(image_token), 1, dims, strides);
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+bool h5_write_dataset_slice2(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_ImageToken image_token, long dim0, long stride0, long dim1, long stride1)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        hsize_t dims[2] = { dim1, dim0 };
+        hsize_t strides[2] = { stride1, stride0 };
+        result = do_write_dataset_slice(filename, location, offset_token, DM::Image(image_token), 2, dims, strides);
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
+bool h5_write_dataset_slice3(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_ImageToken image_token, long dim0, long stride0, long dim1, long stride1, long dim2, long stride2)
+{
+    bool result = false;
+
+    PLUG_IN_ENTRY
+
+        hsize_t dims[3] = { dim2, dim1, dim0 };
+        hsize_t strides[3] = { stride2, stride1, stride0 };
+        result = do_write_dataset_slice(filename, location, offset_token, DM::Image(image_token), 3, dims, strides);
+
+    PLUG_IN_EXIT
+
+    return result;
+}
+
 DM_StringToken_1Ref h5_read_string_dataset(const char* filename, DM_StringToken location)
 {
     DM::String result;
 
     PLUG_IN_ENTRY
 
-        file_handle_t file(H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT));
+        library_lock_t lock(filename);
+        file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
         if (!file.valid()) {
             warning("h5_read_string_dataset: Can't open file '%s'.", filename);
             return NULL;
         }
 
         std::string loc_name = to_UTF8(DM::String(location));
-        dataset_handle_t data(H5Oopen(file.get(), loc_name.c_str(), H5P_DEFAULT));
+        dataset_handle_t data = open_dataset(file.get(), loc_name.c_str());
         if (!data.valid()) {
             warning("h5_read_string_dataset: Invalid location '%s'.", loc_name.c_str());
             return NULL;
@@ -373,7 +1941,7 @@ DM_StringToken_1Ref h5_read_string_dataset(const char* filename, DM_StringToken
 
         if (H5Tis_variable_str(type.get())) {
             // variable length string
-            scoped_ptr<char, free> str_data;
+            scoped_ptr<char, free_HDF> str_data;
 
             type_handle_t str_type(H5Tcopy(H5T_C_S1));
             H5Tset_size(str_type.get(), H5T_VARIABLE);
@@ -0,0 +1,595 @@
+#include "plugin.h"
+#include <stdlib.h>
+#include <list>
+#include <map>
+#include <algorithm>
+
+using namespace Gatan;
+
+struct file_cache_entry_t
+{
+    std::string path;       // Normalized file name
+    bool        writable;   // Opened with H5F_ACC_RDWR
+    bool        pinned;     // Opened by h5_open(), not subject to eviction
+    file_stamp_t stamp;     // Of the file when it was opened, to detect changes by other programs
+    hid_t       file_id;
+    std::map<std::string, hid_t> datasets;  // Datasets kept open, see open_cached_dataset()
+    unsigned long appends;  // Frames appended since the last flush, see flush_file_after_append()
+};
+
+typedef std::list<file_cache_entry_t> file_cache_t;
+
+// Most recently used entries are at the front
+static file_cache_t  file_cache;
+// Files are only kept open on request, an open file can't be deleted or renamed
+static std::size_t   file_cache_capacity = 0;
+static unsigned long file_cache_hits = 0;
+static unsigned long file_cache_misses = 0;
+static unsigned long file_cache_evictions = 0;
+// Files kept open without h5_open() are flushed after this many calls of h5_append()
+static const unsigned long append_flush_interval = 64;
+
+struct cache_config_t
+{
+    std::size_t chunk_cache_bytes;      // rdcc_nbytes
+    std::size_t chunk_cache_slots;      // rdcc_nslots
+    double      chunk_cache_w0;         // rdcc_w0
+    std::size_t metadata_cache_size;    // Initial size of metadata cache, 0 for library default
+    bool        auto_chunk_cache;       // Size chunk cache per dataset from chunk shape
+    std::size_t auto_chunk_cache_limit; // Upper limit of automatically sized chunk cache
+};
+
+// Defaults are the defaults of the HDF5 library, the limit is smaller for 32 bit processes
+static cache_config_t cache_config = { 1024 * 1024, 521, 0.75, 0, false, (sizeof(void*) > 4 ? 256 : 32) * 1024 * 1024 };
+
+// Returns file access property list according to cache_config
+static plist_handle_t create_file_access_plist()
+{
+    plist_handle_t fapl(H5Pcreate(H5P_FILE_ACCESS));
+    if (!fapl.valid()) {
+        dump_HDF_error_stack();
+        return fapl;
+    }
+
+    // Windows builds of HDF5 1.8 default to the windows driver, but reading
+    // contiguous datasets directly needs the sec2 driver
+    if (H5Pset_fapl_sec2(fapl.get()) < 0) {
+        warning("Setting file driver failed.");
+        dump_HDF_error_stack();
+    }
+
+    if (H5Pset_cache(fapl.get(), 0, cache_config.chunk_cache_slots, cache_config.chunk_cache_bytes, cache_config.chunk_cache_w0) < 0) {
+        warning("Setting chunk cache failed.");
+        dump_HDF_error_stack();
+    }
+
+    if (cache_config.metadata_cache_size > 0) {
+        H5AC_cache_config_t mdc_config;
+        mdc_config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+        if (H5Pget_mdc_config(fapl.get(), &mdc_config) >= 0) {
+            mdc_config.set_initial_size = 1;
+            mdc_config.initial_size = cache_config.metadata_cache_size;
+            if (mdc_config.max_size < mdc_config.initial_size)
+                mdc_config.max_size = mdc_config.initial_size;
+            if (mdc_config.min_size > mdc_config.initial_size)
+                mdc_config.min_size = mdc_config.initial_size;
+        
+            if (H5Pset_mdc_config(fapl.get(), &mdc_config) < 0) {
+                warning("Setting metadata cache failed.");
+                dump_HDF_error_stack();
+            }
+        }
+    }
+
+    return fapl;
+}
+
+static std::size_t next_prime(std::size_t n)
+{
+    if (n <= 2)
+        return 2;
+
+    for (n |= 1; ; n += 2) {
+        std::size_t d = 3;
+        while (d * d <= n && n % d != 0)
+            d += 2;
+        if (d * d > n)
+            return n;
+    }
+}
+
+// Returns size of chunk cache, which holds all chunks needed for a plane of the two
+// fastest varying dimensions of the dataset. Returns 0 for unchunked datasets.
+static std::size_t auto_chunk_cache_size(hid_t dset_id, std::size_t& num_chunks)
+{
+    plist_handle_t dcpl(H5Dget_create_plist(dset_id));
+    if (!dcpl.valid() || H5Pget_layout(dcpl.get()) != H5D_CHUNKED)
+        return 0;
+
+    space_handle_t space(H5Dget_space(dset_id));
+    type_handle_t type(H5Dget_type(dset_id));
+    std::vector<hsize_t> dims;
+    int rank = space.valid() ? hsize_array_from_HDF5(space.get(), dims) : -1;
+    if (rank <= 0 || !type.valid())
+        return 0;
+
+    std::vector<hsize_t> chunk(rank);
+    if (H5Pget_chunk(dcpl.get(), rank, &chunk[0]) != rank)
+        return 0;
+
+    hsize_t chunk_bytes = H5Tget_size(type.get());
+    for (int n = 0; n < rank; ++n)
+        chunk_bytes *= chunk[n];
+
+    num_chunks = 1;
+    for (int n = (rank > 2 ? rank - 2 : 0); n < rank; ++n)
+        num_chunks *= std::size_t((dims[n] + chunk[n] - 1) / chunk[n]);
+
+    hsize_t size = chunk_bytes * num_chunks;
+    if (size > cache_config.auto_chunk_cache_limit) {
+        num_chunks = std::size_t(cache_config.auto_chunk_cache_limit / chunk_bytes);
+        if (num_chunks == 0) {
+            // Holding at least one chunk still avoids decompressing it for each read
+            debug("auto_chunk_cache_size: Chunk of %.0f bytes exceeds AutoChunkCacheLimit, caching one chunk.\n", double(chunk_bytes));
+            num_chunks = 1;
+        }
+        size = chunk_bytes * num_chunks;
+    }
+
+    return std::size_t(size);
+}
+
+std::string normalize_path(const char* filename)
+{
+    char buffer[_MAX_PATH];
+    if (!_fullpath(buffer, filename, _MAX_PATH))
+        return filename;
+
+    return buffer;
+}
+
+// Returns entry for path (writable entries are preferred), or end().
+static file_cache_t::iterator find_entry(const std::string& path)
+{
+    file_cache_t::iterator found = file_cache.end();
+    for (file_cache_t::iterator iter = file_cache.begin(); iter != file_cache.end(); ++iter) {
+        // Windows file names are case independent
+        if (_stricmp(iter->path.c_str(), path.c_str()) != 0)
+            continue;
+        if (iter->writable)
+            return iter;
+        found = iter;
+    }
+
+    return found;
+}
+
+static void close_datasets(file_cache_entry_t& entry)
+{
+    for (std::map<std::string, hid_t>::const_iterator iter = entry.datasets.begin(); iter != entry.datasets.end(); ++iter)
+        H5Dclose(iter->second);
+    entry.datasets.clear();
+}
+
+static void close_entry(file_cache_t::iterator iter)
+{
+    hid_t file_id = iter->file_id;
+    close_datasets(*iter);
+    file_cache.erase(iter);
+
+    if (H5Fclose(file_id) < 0) {
+        warning("Closing cached file failed.");
+        dump_HDF_error_stack();
+    }
+}
+
+// Closes least recently used unpinned entries until capacity is met.
+static void trim_cache()
+{
+    std::size_t unpinned = 0;
+    for (file_cache_t::const_iterator iter = file_cache.begin(); iter != file_cache.end(); ++iter)
+        if (!iter->pinned)
+            ++unpinned;
+
+    file_cache_t::iterator iter = file_cache.end();
+    while (unpinned > file_cache_capacity && iter != file_cache.begin()) {
+        --iter;
+        if (iter->pinned)
+            continue;
+
+        debug("File cache: evicting '%s'.\n", iter->path.c_str());
+        close_entry(iter++);
+        ++file_cache_evictions;
+        --unpinned;
+    }
+}
+
+// Takes ownership of file_id. Returns new reference to the file.
+static file_handle_t insert_entry(const std::string& path, bool writable, bool pinned, hid_t file_id)
+{
+    if (!pinned && file_cache_capacity == 0)
+        return file_handle_t(file_id);
+
+    file_cache_entry_t entry;
+    entry.path = path;
+    entry.writable = writable;
+    entry.pinned = pinned;
+    entry.stamp.size = entry.stamp.mtime = 0;
+    get_file_stamp(path, entry.stamp);
+    entry.file_id = file_id;
+    entry.appends = 0;
+    file_cache.push_front(entry);
+    trim_cache();
+
+    H5Iinc_ref(file_id);
+    return file_handle_t(file_id);
+}
+
+static file_handle_t open_cached(const char* filename, unsigned flags, bool pin)
+{
+    bool writable = (flags & H5F_ACC_RDWR) != 0;
+    std::string path = normalize_path(filename);
+    if (writable) {
+        invalidate_decoded_cache(path);
+        invalidate_info_index(path);
+    }
+
+    bool pinned = pin;
+    file_cache_t::iterator iter = find_entry(path);
+
+    // Superblock and chunk index of a read-only file are stale, when another program changed it
+    file_stamp_t stamp;
+    if (iter != file_cache.end() && !iter->writable && !iter->pinned
+        && (!get_file_stamp(path, stamp) || stamp != iter->stamp)) {
+        debug("File cache: '%s' was changed, reopening.\n", path.c_str());
+        close_entry(iter);
+        iter = file_cache.end();
+    }
+
+    if (iter != file_cache.end()) {
+        if (iter->writable || !writable) {
+            ++file_cache_hits;
+            iter->pinned = iter->pinned || pin;
+            file_cache.splice(file_cache.begin(), file_cache, iter);
+
+            H5Iinc_ref(iter->file_id);
+            return file_handle_t(iter->file_id);
+        }
+
+        // HDF5 can't open a file read-write, while it is open read-only.
+        pinned = pinned || iter->pinned;
+        close_entry(iter);
+    }
+
+    ++file_cache_misses;
+    plist_handle_t fapl = create_file_access_plist();
+    hid_t file_id = H5Fopen(filename, flags, fapl.get());
+    if (file_id < 0)
+        return file_handle_t();
+
+    return insert_entry(path, writable, pinned, file_id);
+}
+
+file_handle_t open_file(const char* filename, unsigned flags)
+{
+    return open_cached(filename, flags, false);
+}
+
+file_handle_t open_always(const char* filename)
+{
+    file_handle_t file = open_file(filename, H5F_ACC_RDWR);
+    if (!file.valid()) {
+        plist_handle_t fapl = create_file_access_plist();
+        hid_t file_id = H5Fcreate(filename, H5F_ACC_EXCL, H5P_DEFAULT, fapl.get());
+        if (file_id >= 0)
+            file = insert_entry(normalize_path(filename), true, false, file_id);
+    }
+
+    return file;
+}
+
+dataset_handle_t open_dataset(hid_t loc_id, const char* name)
+{
+    plist_handle_t dapl(H5Pcreate(H5P_DATASET_ACCESS));
+    if (!dapl.valid()) {
+        dump_HDF_error_stack();
+        return dataset_handle_t();
+    }
+
+    std::size_t nbytes = cache_config.chunk_cache_bytes;
+    std::size_t nslots = cache_config.chunk_cache_slots;
+    if (cache_config.auto_chunk_cache) {
+        dataset_handle_t data(H5Dopen(loc_id, name, H5P_DEFAULT));
+        if (!data.valid())
+            return data;
+
+        std::size_t num_chunks = 0;
+        std::size_t size = auto_chunk_cache_size(data.get(), num_chunks);
+        if (size <= nbytes)
+            return data;
+
+        // Slots should be a prime, about 100 times the number of chunks in cache
+        debug("open_dataset: chunk cache for '%s' set to %u bytes / %u chunks.\n", name, unsigned(size), unsigned(num_chunks));
+        nbytes = size;
+        nslots = std::max(nslots, next_prime(100 * num_chunks));
+    }
+
+    if (H5Pset_chunk_cache(dapl.get(), nslots, nbytes, cache_config.chunk_cache_w0) < 0) {
+        warning("Setting chunk cache failed.");
+        dump_HDF_error_stack();
+    }
+
+    return dataset_handle_t(H5Dopen(loc_id, name, dapl.get()));
+}
+
+dataset_handle_t open_cached_dataset(hid_t file_id, const char* name)
+{
+    file_cache_t::iterator entry = file_cache.begin();
+    while (entry != file_cache.end() && entry->file_id != file_id)
+        ++entry;
+
+    // Not cached files don't keep datasets open
+    if (entry == file_cache.end())
+        return open_dataset(file_id, name);
+
+    std::map<std::string, hid_t>::const_iterator iter = entry->datasets.find(name);
+    if (iter == entry->datasets.end()) {
+        dataset_handle_t data = open_dataset(file_id, name);
+        if (!data.valid())
+            return data;
+        iter = entry->datasets.insert(std::make_pair(std::string(name), data.release())).first;
+    }
+
+    H5Iinc_ref(iter->second);
+    return dataset_handle_t(iter->second);
+}
+
+void forget_cached_datasets(hid_t file_id)
+{
+    for (file_cache_t::iterator iter = file_cache.begin(); iter != file_cache.end(); ++iter)
+        if (iter->file_id == file_id)
+            close_datasets(*iter);
+}
+
+void flush_file(hid_t file_id)
+{
+    // Files opened by h5_open() are flushed by h5_flush() or h5_close()
+    for (file_cache_t::const_iterator iter = file_cache.begin(); iter != file_cache.end(); ++iter)
+        if (iter->file_id == file_id && iter->pinned)
+            return;
+
+    if (H5Fflush(file_id, H5F_SCOPE_LOCAL) < 0) {
+        warning("Flushing file failed.");
+        dump_HDF_error_stack();
+    }
+}
+
+void flush_file_after_append(hid_t file_id)
+{
+    file_cache_t::iterator iter = file_cache.begin();
+    while (iter != file_cache.end() && iter->file_id != file_id)
+        ++iter;
+
+    // Files not kept open are flushed when they are closed at the end of the call
+    if (iter == file_cache.end() || iter->pinned)
+        return;
+
+    if (++iter->appends < append_flush_interval)
+        return;
+
+    iter->appends = 0;
+    flush_file(file_id);
+}
+
+void close_file_cache()
+{
+    while (!file_cache.empty())
+        close_entry(file_cache.begin());
+}
+
+bool h5_open(const char* filename, bool writable)
+{
+    PLUG_IN_ENTRY
+
+        library_lock_t lock(filename);
+        file_handle_t file;
+        if (writable) {
+            file = open_always(filename);
+            if (file.valid())
+                file = open_cached(filename, H5F_ACC_RDWR, true);
+        } else
+            file = open_cached(filename, H5F_ACC_RDONLY, true);
+
+        if (!file.valid()) {
+            warning("h5_open: Can't open file '%s'.", filename);
+            return false;
+        }
+
+    PLUG_IN_EXIT
+
+    return true;
+}
+
+bool h5_open_readonly(const char* filename)
+{
+    return h5_open(filename, false);
+}
+
+bool h5_close(const char* filename)
+{
+    bool found = false;
+
+    PLUG_IN_ENTRY
+
+        // Readahead would reopen the file
+        cancel_readahead();
+        library_lock_t lock(filename);
+        std::string path = normalize_path(filename);
+        file_cache_t::iterator iter;
+        while ((iter = find_entry(path)) != file_cache.end()) {
+            close_entry(iter);
+            found = true;
+        }
+
+    PLUG_IN_EXIT
+
+    return found;
+}
+
+void h5_close_all()
+{
+    PLUG_IN_ENTRY
+
+        // Queued writes and readahead would reopen files
+        wait_write_queue();
+        cancel_readahead();
+        library_lock_t lock;
+        close_file_cache();
+
+    PLUG_IN_EXIT
+}
+
+bool h5_flush(const char* filename)
+{
+    PLUG_IN_ENTRY
+
+        library_lock_t lock(filename);
+        file_cache_t::iterator iter = find_entry(normalize_path(filename));
+        if (iter == file_cache.end()) {
+            warning("h5_flush: File '%s' is not open.", filename);
+            return false;
+        }
+
+        iter->appends = 0;
+        if (H5Fflush(iter->file_id, H5F_SCOPE_LOCAL) < 0) {
+            warning("h5_flush: Flushing file '%s' failed.", filename);
+            dump_HDF_error_stack();
+            return false;
+        }
+
+    PLUG_IN_EXIT
+
+    return true;
+}
+
+void h5_set_file_cache_size(long size)
+{
+    PLUG_IN_ENTRY
+
+        library_lock_t lock;
+        file_cache_capacity = size > 0 ? std::size_t(size) : 0;
+        trim_cache();
+
+    PLUG_IN_EXIT
+}
+
+bool h5_set_cache_config(DM_TagGroupToken config_token)
+{
+    PLUG_IN_ENTRY
+
+        library_lock_t lock;
+        DM::TagGroup config_tags(config_token);
+        if (!config_tags.IsValid()) {
+            warning("h5_set_cache_config: Invalid config.");
+            return false;
+        }
+
+        // Sizes are read as double, long is only 32 bit
+        cache_config_t config = cache_config;
+        double value;
+        bool flag;
+        if (config_tags.GetTagAsDouble("ChunkCacheBytes", &value)) {
+            if (value < 0) {
+                warning("h5_set_cache_config: ChunkCacheBytes must not be negative.");
+                return false;
+            }
+            config.chunk_cache_bytes = std::size_t(value);
+        }
+        if (config_tags.GetTagAsDouble("ChunkCacheSlots", &value)) {
+            if (value < 1) {
+                warning("h5_set_cache_config: ChunkCacheSlots must be positive.");
+                return false;
+            }
+            config.chunk_cache_slots = std::size_t(value);
+        }
+        if (config_tags.GetTagAsDouble("ChunkCachePreemption", &value)) {
+            if (value < 0.0 || value > 1.0) {
+                warning("h5_set_cache_config: ChunkCachePreemption must be between 0 and 1.");
+                return false;
+            }
+            config.chunk_cache_w0 = value;
+        }
+        if (config_tags.GetTagAsDouble("MetadataCacheSize", &value)) {
+            // Limits of the HDF5 metadata cache (H5C__MIN_MAX_CACHE_SIZE, H5C__MAX_MAX_CACHE_SIZE)
+            if (value != 0 && (value < 1024 || value > 128 * 1024 * 1024)) {
+                warning("h5_set_cache_config: MetadataCacheSize must be 0 or between 1 kB and 128 MB.");
+                return false;
+            }
+            config.metadata_cache_size = std::size_t(value);
+        }
+        if (config_tags.GetTagAsBoolean("AutoChunkCache", &flag))
+            config.auto_chunk_cache = flag;
+        if (config_tags.GetTagAsDouble("AutoChunkCacheLimit", &value)) {
+            if (value < 0) {
+                warning("h5_set_cache_config: AutoChunkCacheLimit must not be negative.");
+                return false;
+            }
+            config.auto_chunk_cache_limit = std::size_t(value);
+        }
+        if (config_tags.GetTagAsDouble("DecodedCacheBytes", &value)) {
+            if (value < 0) {
+                warning("h5_set_cache_config: DecodedCacheBytes must not be negative.");
+                return false;
+            }
+            set_decoded_cache_size(std::size_t(value));
+        }
+
+        cache_config = config;
+
+    PLUG_IN_EXIT
+
+    return true;
+}
+
+DM_TagGroupToken_1Ref h5_get_cache_config()
+{
+    DM::TagGroup tags;
+
+    PLUG_IN_ENTRY
+
+        library_lock_t lock;
+        tags = DM::NewTagGroup();
+        tags.SetTagAsDouble("ChunkCacheBytes", double(cache_config.chunk_cache_bytes));
+        tags.SetTagAsDouble("ChunkCacheSlots", double(cache_config.chunk_cache_slots));
+        tags.SetTagAsDouble("ChunkCachePreemption", cache_config.chunk_cache_w0);
+        tags.SetTagAsDouble("MetadataCacheSize", double(cache_config.metadata_cache_size));
+        tags.SetTagAsBoolean("AutoChunkCache", cache_config.auto_chunk_cache);
+        tags.SetTagAsDouble("AutoChunkCacheLimit", double(cache_config.auto_chunk_cache_limit));
+        tags.SetTagAsDouble("DecodedCacheBytes", double(get_decoded_cache_size()));
+
+    PLUG_IN_EXIT
+
+    return tags.release();
+}
+
+DM_TagGroupToken_1Ref h5_file_cache_stats()
+{
+    DM::TagGroup tags;
+
+    PLUG_IN_ENTRY
+
+        library_lock_t lock;
+        tags = DM::NewTagGroup();
+        tags.SetTagAsLong("Capacity", long(file_cache_capacity));
+        tags.SetTagAsLong("Open", long(file_cache.size()));
+        tags.SetTagAsUInt32("Hits", file_cache_hits);
+        tags.SetTagAsUInt32("Misses", file_cache_misses);
+        tags.SetTagAsUInt32("Evictions", file_cache_evictions);
+        decoded_cache_stats(tags);
+        readahead_stats(tags);
+        tags.SetTagAsUInt32("DirectReads", get_direct_read_count());
+
+    PLUG_IN_EXIT
+
+    return tags.release();
+}
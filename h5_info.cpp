@@ -1,10 +1,11 @@
 #include "plugin.h"
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
 
 using namespace Gatan;
 
-// Forwards
-static DM::TagGroup get_object_info(hid_t loc_id, const std::string& loc_name, const char* name);
-
 static std::string get_fullname(const std::string& loc_name, const char* name)
 {
     std::string fullname = loc_name;
@@ -18,126 +19,269 @@ static std::string get_fullname(const std::string& loc_name, const char* name)
     return fullname;
 }
 
-static DM::TagGroup get_softlink_info(hid_t loc_id, const std::string& loc_name, const char* name, size_t val_size)
+// Properties of an object, queried once per object, even if it has several links
+struct object_info_t
 {
-    DM::TagGroup tags = DM::NewTagGroup();
-    tags.SetTagAsString("Name", from_UTF8(get_fullname(loc_name, name)));
-    tags.SetTagAsString("Type", "SoftLink");
+    H5O_type_t           type;
+    bool                 valid;         // Whether properties could be read
+    bool                 simple;        // Simple data space
+    int                  rank;
+    std::vector<hsize_t> dims, maxdims;
+    H5T_class_t          type_class;
+    long                 dtype;
+    std::vector<hsize_t> chunk;         // Empty for other layouts
+
+    // Storage statistics, only if requested by the options
+    bool                     storage;           // Whether statistics were queried
+    H5D_layout_t             layout;
+    hsize_t                  storage_size;      // Bytes allocated in the file
+    hsize_t                  data_size;         // Bytes of all elements
+    std::vector<std::string> filters;           // Names of filters
+    long long                num_chunks;        // Allocated chunks, -1 if unknown
+    hsize_t                  min_chunk_bytes, max_chunk_bytes;
+    hsize_t                  p10_chunk_bytes, median_chunk_bytes, p90_chunk_bytes;
+
+    object_info_t()
+    : type(H5O_TYPE_UNKNOWN), valid(false), simple(false), rank(-1), type_class(H5T_NO_CLASS), dtype(-1),
+      storage(false), layout(H5D_LAYOUT_ERROR), storage_size(0), data_size(0), num_chunks(-1), 
+      min_chunk_bytes(0), max_chunk_bytes(0), p10_chunk_bytes(0), median_chunk_bytes(0), p90_chunk_bytes(0)
+    {}
+};
 
-    std::vector<char> value(val_size);
-    if (H5Lget_val(loc_id, name, &value[0], val_size, H5P_DEFAULT) < 0)
-        return DM::TagGroup();
+typedef std::map<haddr_t, object_info_t> object_map_t;
 
-    tags.SetTagAsString("Path", from_UTF8(&value[0]));
+/**
+ * Entry of the listing returned by h5_info. The listing is a vector of nodes in
+ * preorder, the members of a group follow the group.
+ */
+struct info_node_t
+{
+    enum kind_t { OBJECT, SOFT_LINK, EXTERNAL_LINK };
+
+    kind_t          kind;
+    std::string     name;           // Full name
+    object_info_t   object;         // Objects only
+    std::string     filename;       // External links only
+    std::string     path;           // Links only
+    unsigned        flags;          // External links only
+    long            num_contents;   // Number of listed members, -1 if no contents are listed
+    long            num_members;    // Number of all members, -1 if not reported
+
+    info_node_t()
+    : kind(OBJECT), flags(0), num_contents(-1), num_members(-1)
+    {}
+};
 
-    return tags;
-}
+typedef std::vector<info_node_t> info_nodes_t;
+
+// Querying basic info only (no header and attribute counts) was added in HDF5 1.10.3
+#if H5_VERSION_GE(1, 10, 3)
+#   define get_object_info_by_name(loc_id, name, info) H5Oget_info_by_name2(loc_id, name, info, H5O_INFO_BASIC, H5P_DEFAULT)
+#else
+#   define get_object_info_by_name(loc_id, name, info) H5Oget_info_by_name(loc_id, name, info, H5P_DEFAULT)
+#endif
+
+// Querying chunks by coordinate was added in HDF5 1.10.5
+#if H5_VERSION_GE(1, 10, 5)
+#   define HAVE_CHUNK_INFO
+#endif
 
-static DM::TagGroup get_externallink_info(hid_t loc_id, const std::string& loc_name, const char* name, size_t val_size)
+#ifdef HAVE_CHUNK_INFO
+// Chunk grids larger than this multiple of the allocated chunks are not scanned for chunk sizes
+static const hsize_t max_sparse_factor = 16;
+
+// Returns the nearest rank percentile of sizes, which are partially reordered.
+static hsize_t chunk_percentile(std::vector<hsize_t>& sizes, std::size_t percent)
 {
-    DM::TagGroup tags = DM::NewTagGroup();
-    tags.SetTagAsString("Name", from_UTF8(get_fullname(loc_name, name)));
-    tags.SetTagAsString("Type", "ExternalLink");
-    
-    std::vector<char> value(val_size);
-    if (H5Lget_val(loc_id, name, &value[0], val_size, H5P_DEFAULT) < 0)
-        return DM::TagGroup();
+    std::vector<hsize_t>::iterator nth = sizes.begin() + (sizes.size() - 1) * percent / 100;
+    std::nth_element(sizes.begin(), nth, sizes.end());
+    return *nth;
+}
 
-    const char* filename = 0;
-    const char* path = 0;
-    unsigned flags = 0;
-    if (H5Lunpack_elink_val(&value[0], val_size, &flags, &filename, &path) < 0)
-        return DM::TagGroup();
+// Gets number and sizes of allocated chunks.
+static void query_chunks(hid_t dset_id, hid_t space_id, object_info_t& object)
+{
+    hsize_t num_chunks;
+    if (H5Dget_num_chunks(dset_id, space_id, &num_chunks) < 0)
+        return;
+    object.num_chunks = (long long)num_chunks;
+
+    hsize_t grid_size = 1;
+    for (int n = 0; n < object.rank; ++n)
+        grid_size *= (object.dims[n] + object.chunk[n] - 1) / object.chunk[n];
+    if (num_chunks == 0 || grid_size > max_sparse_factor * num_chunks + 65536)
+        return;
+
+    // Looking up each chunk of the grid takes linear time, other than by index
+    std::vector<hsize_t> offset(object.rank, 0), sizes;
+    sizes.reserve(std::size_t(num_chunks));
+    for (hsize_t n = 0; n < grid_size; ++n) {
+        unsigned filter_mask;
+        haddr_t addr;
+        hsize_t size;
+        if (H5Dget_chunk_info_by_coord(dset_id, &offset[0], &filter_mask, &addr, &size) >= 0 && addr != HADDR_UNDEF) {
+            if (object.max_chunk_bytes == 0 || size < object.min_chunk_bytes)
+                object.min_chunk_bytes = size;
+            if (size > object.max_chunk_bytes)
+                object.max_chunk_bytes = size;
+            sizes.push_back(size);
+        }
 
-    tags.SetTagAsString("Filename", from_UTF8(filename));
-    tags.SetTagAsString("Path", from_UTF8(path));
-    tags.SetTagAsUInt32("Flags", flags);
+        for (int d = object.rank - 1; d >= 0; --d) {
+            offset[d] += object.chunk[d];
+            if (offset[d] < object.dims[d])
+                break;
+            offset[d] = 0;
+        }
+    }
 
-    return tags;
+    if (!sizes.empty()) {
+        object.p10_chunk_bytes = chunk_percentile(sizes, 10);
+        object.median_chunk_bytes = chunk_percentile(sizes, 50);
+        object.p90_chunk_bytes = chunk_percentile(sizes, 90);
+    }
 }
+#endif
 
-struct group_iterator_param_t
+// Gets layout, size, and filters of storage.
+static void query_storage(hid_t dset_id, hid_t space_id, hid_t type_id, hid_t dcpl_id, object_info_t& object)
 {
-    const std::string& loc_name;
-    DM::TagGroup&      parent;
+    object.storage = true;
+    object.layout = H5Pget_layout(dcpl_id);
+    object.storage_size = H5Dget_storage_size(dset_id);
+    hssize_t npoints = H5Sget_simple_extent_npoints(space_id);
+    object.data_size = npoints > 0 ? hsize_t(npoints) * H5Tget_size(type_id) : 0;
+
+    int nfilters = H5Pget_nfilters(dcpl_id);
+    for (int n = 0; n < nfilters; ++n) {
+        size_t cd_nelmts = 0;
+        char name[64] = "";
+        unsigned flags, config;
+        if (H5Pget_filter2(dcpl_id, unsigned(n), &flags, &cd_nelmts, NULL, sizeof(name), name, &config) < 0)
+            continue;
+        name[sizeof(name) - 1] = 0;
+        object.filters.push_back(*name ? name : "Unknown");
+    }
 
-    group_iterator_param_t(const std::string& _loc_name, DM::TagGroup& _parent)
-    : loc_name(_loc_name), parent(_parent) 
-    {}
-};
+#ifdef HAVE_CHUNK_INFO
+    if (object.layout == H5D_CHUNKED && !object.chunk.empty() && !object.dims.empty())
+        query_chunks(dset_id, space_id, object);
+#endif
+}
 
-static herr_t group_iterator(hid_t loc_id, const char *name, const H5L_info_t *info, group_iterator_param_t *param) 
+/**
+ * Queries data space, type, and layout of dataset.
+ * @param storage Whether to query storage statistics.
+ */
+static bool query_dataset(hid_t dset_id, bool storage, object_info_t& object)
 {
-    DM::TagGroup tags;
-    switch (info->type) {
-    case H5L_TYPE_HARD:
-        tags = get_object_info(loc_id, param->loc_name, name);
-        break;
+    space_handle_t space(H5Dget_space(dset_id));
+    type_handle_t type(H5Dget_type(dset_id));
+    if (!space.valid() || !type.valid())
+        return false;
 
-    case H5L_TYPE_SOFT:
-        tags = get_softlink_info(loc_id, param->loc_name, name, info->u.val_size);
-        break;
+    object.simple = H5Sis_simple(space.get()) > 0;
+    object.rank = object.simple ? H5Sget_simple_extent_ndims(space.get()) : -1;
+    if (object.rank > 0) {
+        object.dims.resize(object.rank);
+        object.maxdims.resize(object.rank);
+        if (H5Sget_simple_extent_dims(space.get(), &object.dims[0], &object.maxdims[0]) < 0)
+            object.dims.clear();
+    }
 
-    case H5L_TYPE_EXTERNAL:
-        tags = get_externallink_info(loc_id, param->loc_name, name, info->u.val_size);
-        break;
+    object.type_class = H5Tget_class(type.get());
+    object.dtype = datatype_from_HDF(type.get());
 
-    default:
-        break;  // Ignore unknown link types
+    plist_handle_t plist(H5Dget_create_plist(dset_id));
+    if (plist.valid() && object.rank > 0 && H5Pget_layout(plist.get()) == H5D_CHUNKED) {
+        object.chunk.resize(object.rank);
+        if (H5Pget_chunk(plist.get(), object.rank, &object.chunk[0]) < 0)
+            object.chunk.clear();
     }
 
-    if (tags.IsValid())
-        param->parent.AddTagGroupAtEnd(tags);
+    if (storage && plist.valid())
+        query_storage(dset_id, space.get(), type.get(), plist.get(), object);
 
-    return 0;
+    return true;
 }
 
-static bool get_group_info(hid_t loc_id, const std::string& fullname, const char* name, DM::TagGroup& tags)
+/**
+ * Queries object at address, unless it is known already.
+ * @param loc_id Group with link @p name to object.
+ * @param details Whether to query data space and type of datasets.
+ * @param storage Whether to query storage statistics of datasets, implies @p details.
+ */
+static void query_object(hid_t loc_id, const char* name, haddr_t address, bool details, bool storage, object_map_t& objects)
 {
-    DM::TagGroup contents = tags.CreateNewLabeledList("Contents");
+    if (objects.find(address) != objects.end())
+        return;
+
+    object_info_t& object = objects[address];
+    object.valid = false;
+
+    if (!details && !storage) {
+        // Object header only, datasets are not opened
+        H5O_info_t info;
+        if (get_object_info_by_name(loc_id, name, &info) < 0)
+            return;
+        object.type = info.type;
+        object.valid = true;
+        return;
+    }
 
-    group_handle_t group(H5Gopen(loc_id, name, H5P_DEFAULT));
-    if (!group.valid())
-        return false;
+    // Opening by address avoids resolving the path again
+    object_handle_t obj(H5Oopen_by_addr(loc_id, address));
+    if (!obj.valid())
+        return;
 
-    group_iterator_param_t param(fullname, contents);
-    hsize_t idx = 0;
-    H5Literate(group.get(), H5_INDEX_NAME, H5_ITER_INC, &idx, (H5L_iterate_t)&group_iterator, &param);
+    switch (H5Iget_type(obj.get())) {
+    case H5I_GROUP:
+        object.type = H5O_TYPE_GROUP;
+        object.valid = true;
+        break;
 
-    return true;
+    case H5I_DATASET:
+        object.type = H5O_TYPE_DATASET;
+        object.valid = query_dataset(obj.get(), storage, object);
+        break;
+
+    case H5I_DATATYPE:
+        object.type = H5O_TYPE_NAMED_DATATYPE;
+        object.valid = true;
+        break;
+
+    default:
+        object.type = H5O_TYPE_UNKNOWN;
+        object.valid = true;
+        break;
+    }
 }
 
-// Returns rank
-static int get_space_info(hid_t space_id, DM::TagGroup& tags)
+static void get_space_info(const object_info_t& object, DM::TagGroup& tags)
 {
-    if (!H5Sis_simple(space_id)) {
+    if (!object.simple) {
         tags.SetTagAsString("DataSpaceClass", "Unknown");
-        return -1;
+        return;
     }
 
-    int rank = H5Sget_simple_extent_ndims(space_id);
-    if (rank < 0)
-        return -1;
+    if (object.rank < 0)
+        return;
 
-    tags.SetTagAsLong("Rank", rank);
-    if (rank > 0) {
+    tags.SetTagAsLong("Rank", object.rank);
+    if (object.rank > 0) {
         tags.SetTagAsString("DataSpaceClass", "SIMPLE");
 
-        std::vector<hsize_t> dims(rank*2);
-        if (H5Sget_simple_extent_dims(space_id, &dims[0], &dims[rank]) < 0)
-            return -1;
-
-        tags.SetTagAsTagGroup("Size", taglist_from_hsize_array(&dims[0], rank));
-        tags.SetTagAsTagGroup("MaxSize", taglist_from_hsize_array(&dims[rank], rank));
-    } else if (rank == 0)
+        if (!object.dims.empty()) {
+            tags.SetTagAsTagGroup("Size", taglist_from_hsize_array(&object.dims[0], object.rank));
+            tags.SetTagAsTagGroup("MaxSize", taglist_from_hsize_array(&object.maxdims[0], object.rank));
+        }
+    } else
         tags.SetTagAsString("DataSpaceClass", "SCALAR");
-
-    return rank;
 }
 
-static void get_type_info(hid_t type_id, DM::TagGroup& tags)
+static void get_type_info(const object_info_t& object, DM::TagGroup& tags)
 {
-    switch (H5Tget_class(type_id)) {
+    switch (object.type_class) {
     case H5T_INTEGER:
         tags.SetTagAsString("DataTypeClass", "INTEGER");
         break;
@@ -183,86 +327,623 @@ static void get_type_info(hid_t type_id, DM::TagGroup& tags)
         break;
     }
 
-    long dtype = datatype_from_HDF(type_id);
-    if (dtype >= 0)
-        tags.SetTagAsLong("DataType", dtype);
+    if (object.dtype >= 0)
+        tags.SetTagAsLong("DataType", object.dtype);
+}
+
+// Options of h5_info, read from the options TagGroup by parse_info_options()
+struct info_options_t
+{
+    long                     max_depth;     // Levels of groups listed, -1 for all
+    std::vector<std::string> types;         // Types of listed objects (except groups), empty for all
+    bool                     details;       // Whether to query data space and type of datasets
+    bool                     storage;       // Whether to query storage statistics of datasets
+    long                     start;         // First member of group listed
+    long                     count;         // Maximum number of members listed, -1 for all
+    bool                     paged;         // Whether start or count is given
+
+    info_options_t()
+    : max_depth(-1), details(true), storage(false), start(0), count(-1), paged(false)
+    {}
+};
+
+static const char* object_type_name(H5O_type_t type)
+{
+    switch (type) {
+    case H5O_TYPE_GROUP:            return "Group";
+    case H5O_TYPE_DATASET:          return "DataSet";
+    case H5O_TYPE_NAMED_DATATYPE:   return "NamedDataType";
+    default:                        return "Unknown";
+    }
+}
+
+/**
+ * Reads comma separated list of object types from key "Types".
+ * @param func Name of calling function for messages.
+ * @param types OUT: Type names, empty if the key is missing.
+ * @returns Whether succeeded.
+ */
+static bool parse_types(const char* func, const DM::TagGroup& tags, std::vector<std::string>& types)
+{
+    DM::String types_str;
+    if (!tags.GetTagAsString("Types", &types_str))
+        return true;
+
+    std::string list = to_UTF8(types_str);
+    std::string::size_type begin = 0;
+    while (begin <= list.size()) {
+        std::string::size_type end = list.find(',', begin);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string::size_type first = list.find_first_not_of(" \t", begin);
+        std::string::size_type last = list.find_last_not_of(" \t", end - 1);
+        if (first < end && last != std::string::npos && last >= first)
+            types.push_back(list.substr(first, last - first + 1));
+        begin = end + 1;
+    }
+
+    static const char* known[] = { "Group", "DataSet", "NamedDataType", "SoftLink", "ExternalLink", "Unknown" };
+    for (std::size_t n = 0; n < types.size(); ++n) {
+        std::size_t k = 0;
+        while (k < sizeof(known) / sizeof(known[0]) && _stricmp(known[k], types[n].c_str()) != 0)
+            ++k;
+        if (k == sizeof(known) / sizeof(known[0])) {
+            warning("%s: Unknown type '%s' in Types.", func, types[n].c_str());
+            return false;
+        }
+    }
+
+    return true;
 }
 
-static bool get_dataset_info(hid_t loc_id, const char* name, DM::TagGroup& tags)
+static bool type_in_list(const std::vector<std::string>& types, const char* type)
 {
-    dataset_handle_t dset(H5Dopen(loc_id, name, H5P_DEFAULT));
-    if (!dset.valid())
+    for (std::size_t n = 0; n < types.size(); ++n)
+        if (_stricmp(types[n].c_str(), type) == 0)
+            return true;
+
+    return false;
+}
+
+/**
+ * Reads options of h5_info. Does not call the HDF5 library.
+ * @param options TagGroup with options, may be invalid.
+ * @param result OUT: Options.
+ * @returns Whether succeeded.
+ */
+static bool parse_info_options(const DM::TagGroup& options, info_options_t& result)
+{
+    if (!options.IsValid())
+        return true;
+
+    options.GetTagAsLong("MaxDepth", &result.max_depth);
+    options.GetTagAsBoolean("Details", &result.details);
+    options.GetTagAsBoolean("Storage", &result.storage);
+    result.paged = options.GetTagAsLong("Start", &result.start);
+    result.paged = options.GetTagAsLong("Count", &result.count) || result.paged;
+    if (result.max_depth < -1 || result.start < 0 || result.count < -1) {
+        warning("h5_info: Start must not be negative, MaxDepth and Count must be -1 or larger.");
+        return false;
+    }
+
+    if (!parse_types("h5_info", options, result.types))
         return false;
 
-    space_handle_t space(H5Dget_space(dset.get()));
-    if (!space.valid())
+    return true;
+}
+
+// Returns whether objects of type are listed. Groups are always listed, they hold the other objects.
+static bool is_type_listed(const info_options_t& options, const char* type)
+{
+    return options.types.empty() || strcmp(type, "Group") == 0 || type_in_list(options.types, type);
+}
+
+static bool get_softlink_info(hid_t loc_id, const std::string& loc_name, const char* name, size_t val_size, info_node_t& node)
+{
+    std::vector<char> value(val_size);
+    if (H5Lget_val(loc_id, name, &value[0], val_size, H5P_DEFAULT) < 0)
         return false;
-    int rank = get_space_info(space.get(), tags);
 
-    type_handle_t type(H5Dget_type(dset.get()));
-    if (!type.valid())
+    node.kind = info_node_t::SOFT_LINK;
+    node.name = get_fullname(loc_name, name);
+    node.path = &value[0];
+    return true;
+}
+
+static bool get_externallink_info(hid_t loc_id, const std::string& loc_name, const char* name, size_t val_size, info_node_t& node)
+{
+    std::vector<char> value(val_size);
+    if (H5Lget_val(loc_id, name, &value[0], val_size, H5P_DEFAULT) < 0)
         return false;
-    get_type_info(type.get(), tags);
 
-    plist_handle_t plist(H5Dget_create_plist(dset.get()));
-    if (plist.valid() && rank > 0) {
-        std::vector<hsize_t> chunkSize(rank);
-        if (H5Pget_chunk(plist.get(), rank, &chunkSize[0]) >= 0)
-            tags.SetTagAsTagGroup("ChunkSize", taglist_from_hsize_array(&chunkSize[0], rank));
-    }
+    const char* filename = 0;
+    const char* path = 0;
+    unsigned flags = 0;
+    if (H5Lunpack_elink_val(&value[0], val_size, &flags, &filename, &path) < 0)
+        return false;
 
+    node.kind = info_node_t::EXTERNAL_LINK;
+    node.name = get_fullname(loc_name, name);
+    node.filename = filename;
+    node.path = path;
+    node.flags = flags;
     return true;
 }
 
-static DM::TagGroup get_object_info(hid_t loc_id, const std::string& loc_name, const char* name)
+static void get_storage_info(const object_info_t& object, DM::TagGroup& tags)
 {
-    H5O_info_t info;
-    if (H5Oget_info_by_name(loc_id, name, &info, H5P_DEFAULT) < 0)
-        return DM::TagGroup();
+    switch (object.layout) {
+    case H5D_COMPACT:
+        tags.SetTagAsString("Layout", "COMPACT");
+        break;
+
+    case H5D_CONTIGUOUS:
+        tags.SetTagAsString("Layout", "CONTIGUOUS");
+        break;
 
+    case H5D_CHUNKED:
+        tags.SetTagAsString("Layout", "CHUNKED");
+        break;
+
+#if H5_VERSION_GE(1, 10, 0)
+    case H5D_VIRTUAL:
+        tags.SetTagAsString("Layout", "VIRTUAL");
+        break;
+#endif
+
+    default:
+        tags.SetTagAsString("Layout", "Unknown");
+        break;
+    }
+
+    tags.SetTagAsDouble("StorageSize", double(object.storage_size));
+    tags.SetTagAsDouble("DataSize", double(object.data_size));
+    if (object.storage_size > 0)
+        tags.SetTagAsDouble("CompressionRatio", double(object.data_size) / double(object.storage_size));
+
+    DM::TagGroup filters = tags.CreateNewLabeledList("Filters");
+    for (std::size_t n = 0; n < object.filters.size(); ++n)
+        filters.InsertTagAsString(-1, from_UTF8(object.filters[n]));
+
+    if (object.num_chunks >= 0)
+        tags.SetTagAsDouble("NumChunks", double(object.num_chunks));
+    if (object.max_chunk_bytes > 0) {
+        DM::TagGroup chunk_bytes = DM::NewTagGroup();
+        chunk_bytes.SetTagAsDouble("Min", double(object.min_chunk_bytes));
+        chunk_bytes.SetTagAsDouble("Max", double(object.max_chunk_bytes));
+        if (object.num_chunks > 0)
+            chunk_bytes.SetTagAsDouble("Mean", double(object.storage_size) / double(object.num_chunks));
+        chunk_bytes.SetTagAsDouble("P10", double(object.p10_chunk_bytes));
+        chunk_bytes.SetTagAsDouble("Median", double(object.median_chunk_bytes));
+        chunk_bytes.SetTagAsDouble("P90", double(object.p90_chunk_bytes));
+        tags.SetTagAsTagGroup("ChunkBytes", chunk_bytes);
+    }
+}
+
+// Returns tags of object, without contents of groups.
+static DM::TagGroup get_object_tags(const object_info_t& object, const std::string& fullname)
+{
     DM::TagGroup tags = DM::NewTagGroup();
-    std::string fullname = get_fullname(loc_name, name);
     tags.SetTagAsString("Name", from_UTF8(fullname));
+    tags.SetTagAsString("Type", object_type_name(object.type));
+
+    if (object.type == H5O_TYPE_DATASET && object.type_class != H5T_NO_CLASS) {
+        get_space_info(object, tags);
+        get_type_info(object, tags);
+        if (!object.chunk.empty())
+            tags.SetTagAsTagGroup("ChunkSize", taglist_from_hsize_array(&object.chunk[0], object.rank));
+        if (object.storage)
+            get_storage_info(object, tags);
+    }
 
-    switch (info.type) {
-    case H5O_TYPE_GROUP:
-        tags.SetTagAsString("Type", "Group");
-        if (!get_group_info(loc_id, fullname, name, tags))
-           return DM::TagGroup();
-        break;
+    return tags;
+}
+
+/**
+ * Returns tags of node and its members.
+ * @param pos IN/OUT: Index of node, on return index of the node following its members.
+ */
+static DM::TagGroup tags_from_nodes(const info_nodes_t& nodes, std::size_t& pos)
+{
+    const info_node_t& node = nodes[pos++];
+    DM::TagGroup tags;
 
-    case H5O_TYPE_DATASET:
-        tags.SetTagAsString("Type", "DataSet");
-        if (!get_dataset_info(loc_id, name, tags))
-            return DM::TagGroup();
+    switch (node.kind) {
+    case info_node_t::OBJECT:
+        tags = get_object_tags(node.object, node.name);
         break;
 
-    case H5O_TYPE_NAMED_DATATYPE:
-        tags.SetTagAsString("Type", "NamedDataType");
+    case info_node_t::SOFT_LINK:
+        tags = DM::NewTagGroup();
+        tags.SetTagAsString("Name", from_UTF8(node.name));
+        tags.SetTagAsString("Type", "SoftLink");
+        tags.SetTagAsString("Path", from_UTF8(node.path));
         break;
 
-    default:
-        tags.SetTagAsString("Type", "Unknown");
+    case info_node_t::EXTERNAL_LINK:
+        tags = DM::NewTagGroup();
+        tags.SetTagAsString("Name", from_UTF8(node.name));
+        tags.SetTagAsString("Type", "ExternalLink");
+        tags.SetTagAsString("Filename", from_UTF8(node.filename));
+        tags.SetTagAsString("Path", from_UTF8(node.path));
+        tags.SetTagAsUInt32("Flags", node.flags);
         break;
     }
 
+    if (node.num_contents >= 0) {
+        DM::TagGroup contents = tags.CreateNewLabeledList("Contents");
+        for (long n = 0; n < node.num_contents && pos < nodes.size(); ++n)
+            contents.AddTagGroupAtEnd(tags_from_nodes(nodes, pos));
+    }
+    if (node.num_members >= 0)
+        tags.SetTagAsLong("NumMembers", node.num_members);
+
     return tags;
 }
 
+// State of a traversal of the groups below the object passed to h5_info
+struct traversal_t
+{
+    const info_options_t&  options;
+    object_map_t           objects;
+    std::set<haddr_t>      groups;      // Groups listed with their contents already
+    info_nodes_t           nodes;
+
+    traversal_t(const info_options_t& _options)
+    : options(_options)
+    {}
+};
+
+static long get_group_contents(traversal_t& traversal, hid_t group_id, const std::string& group_name, long depth,
+                               hsize_t start, long count);
+
+struct group_iterator_param_t
+{
+    traversal_t&        traversal;
+    const std::string&  group_name;
+    long                depth;      // Depth of members
+    long                count;      // Members left to list, -1 for all
+    long                listed;     // Members listed
+
+    group_iterator_param_t(traversal_t& _traversal, const std::string& _group_name, long _depth, long _count)
+    : traversal(_traversal), group_name(_group_name), depth(_depth), count(_count), listed(0)
+    {}
+};
+
+static herr_t group_iterator(hid_t group_id, const char* name, const H5L_info_t* info, group_iterator_param_t* param)
+{
+    if (param->count == 0)
+        return 1;   // Stops iteration
+    if (param->count > 0)
+        --param->count;
+
+    traversal_t& traversal = param->traversal;
+    const info_options_t& options = traversal.options;
+    info_node_t node;
+
+    switch (info->type) {
+    case H5L_TYPE_HARD: {
+        query_object(group_id, name, info->u.address, options.details, options.storage, traversal.objects);
+        const object_info_t& object = traversal.objects[info->u.address];
+        if (!object.valid || !is_type_listed(options, object_type_name(object.type)))
+            return 0;
+
+        node.name = get_fullname(param->group_name, name);
+        node.object = object;
+        ++param->listed;
+
+        bool expand = options.max_depth < 0 || param->depth < options.max_depth;
+        if (object.type != H5O_TYPE_GROUP || !expand) {
+            traversal.nodes.push_back(node);
+            return 0;
+        }
+
+        // Members of a group with several links are listed only once, this also ends cycles
+        std::size_t index = traversal.nodes.size();
+        traversal.nodes.push_back(node);
+        long num_contents = 0;
+        if (traversal.groups.insert(info->u.address).second) {
+            object_handle_t group(H5Oopen_by_addr(group_id, info->u.address));
+            if (group.valid())
+                num_contents = get_group_contents(traversal, group.get(), node.name, param->depth + 1, 0, -1);
+        }
+        traversal.nodes[index].num_contents = num_contents;
+        return 0;
+    }
+
+    case H5L_TYPE_SOFT:
+        if (!is_type_listed(options, "SoftLink") || !get_softlink_info(group_id, param->group_name, name, info->u.val_size, node))
+            return 0;
+        break;
+
+    case H5L_TYPE_EXTERNAL:
+        if (!is_type_listed(options, "ExternalLink") || !get_externallink_info(group_id, param->group_name, name, info->u.val_size, node))
+            return 0;
+        break;
+
+    default:
+        return 0;   // Ignore unknown link types
+    }
+
+    traversal.nodes.push_back(node);
+    ++param->listed;
+    return 0;
+}
+
+/**
+ * Lists members of group, members of subgroups are listed up to the maximum depth of the options.
+ * @param depth Depth of the members, 1 for members of the object passed to h5_info.
+ * @param start Index of first member listed (in name order).
+ * @param count Maximum number of members listed, -1 for all.
+ * @returns Number of members listed.
+ */
+static long get_group_contents(traversal_t& traversal, hid_t group_id, const std::string& group_name, long depth,
+                               hsize_t start, long count)
+{
+    group_iterator_param_t param(traversal, group_name, depth, count);
+    hsize_t idx = start;
+    H5Literate(group_id, H5_INDEX_NAME, H5_ITER_INC, &idx, (H5L_iterate_t)&group_iterator, &param);
+    return param.listed;
+}
+
+/**
+ * Lists an object and everything below it, in one pass over all links.
+ * Each object is queried once, even if it has several links.
+ * @returns Whether succeeded.
+ */
+static bool get_object_info(hid_t loc_id, const char* name, const info_options_t& options, info_nodes_t& nodes)
+{
+    H5O_info_t info;
+    if (get_object_info_by_name(loc_id, name, &info) < 0)
+        return false;
+
+    object_handle_t obj(H5Oopen(loc_id, name, H5P_DEFAULT));
+    if (!obj.valid())
+        return false;
+
+    traversal_t traversal(options);
+    query_object(obj.get(), ".", info.addr, options.details, options.storage, traversal.objects);
+    const object_info_t& object = traversal.objects[info.addr];
+    if (!object.valid)
+        return false;
+
+    info_node_t node;
+    node.name = get_fullname("", name);
+    node.object = object;
+    traversal.nodes.push_back(node);
+
+    if (info.type == H5O_TYPE_GROUP && options.max_depth != 0) {
+        traversal.nodes[0].num_contents = 0;
+
+        hsize_t num_links = 0;
+        if (options.paged) {
+            H5G_info_t group_info;
+            if (H5Gget_info(obj.get(), &group_info) < 0)
+                return false;
+            num_links = group_info.nlinks;
+            traversal.nodes[0].num_members = long(num_links);
+        }
+
+        if (!options.paged || hsize_t(options.start) < num_links) {
+            traversal.groups.insert(info.addr);
+            long num_contents = get_group_contents(traversal, obj.get(), node.name, 1, options.start, options.count);
+            traversal.nodes[0].num_contents = num_contents;
+        }
+    }
+
+    nodes.swap(traversal.nodes);
+    return true;
+}
+
+//----------------------------------------------------------------------------------------
+// Serialization of the listing for the metadata index
+
+static void write_value(std::vector<char>& data, long long value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(value));
+}
+
+static void write_string(std::vector<char>& data, const std::string& value)
+{
+    write_value(data, (long long)value.size());
+    data.insert(data.end(), value.begin(), value.end());
+}
+
+static void write_dims(std::vector<char>& data, const std::vector<hsize_t>& dims)
+{
+    write_value(data, (long long)dims.size());
+    for (std::size_t n = 0; n < dims.size(); ++n)
+        write_value(data, (long long)dims[n]);
+}
+
+static void serialize_nodes(const info_nodes_t& nodes, std::vector<char>& data)
+{
+    write_value(data, (long long)nodes.size());
+    for (std::size_t n = 0; n < nodes.size(); ++n) {
+        const info_node_t& node = nodes[n];
+        write_value(data, node.kind);
+        write_string(data, node.name);
+        write_value(data, node.num_contents);
+        write_value(data, node.num_members);
+
+        switch (node.kind) {
+        case info_node_t::OBJECT:
+            write_value(data, node.object.type);
+            write_value(data, node.object.simple);
+            write_value(data, node.object.rank);
+            write_dims(data, node.object.dims);
+            write_dims(data, node.object.maxdims);
+            write_value(data, node.object.type_class);
+            write_value(data, node.object.dtype);
+            write_dims(data, node.object.chunk);
+            break;
+
+        case info_node_t::EXTERNAL_LINK:
+            write_string(data, node.filename);
+            write_value(data, node.flags);
+            // fall through
+
+        case info_node_t::SOFT_LINK:
+            write_string(data, node.path);
+            break;
+        }
+    }
+}
+
+// Reads values written by serialize_nodes(), fails on truncated or inconsistent data
+class node_reader_t
+{
+public:
+    node_reader_t(const std::vector<char>& data)
+    : _pos(data.empty() ? NULL : &data[0]), _end(_pos + data.size()), _valid(true)
+    {}
+
+    bool valid() const
+    {
+        return _valid;
+    }
+
+    long long value()
+    {
+        long long result = 0;
+        if (_end - _pos < ptrdiff_t(sizeof(result)))
+            _valid = false;
+        else {
+            memcpy(&result, _pos, sizeof(result));
+            _pos += sizeof(result);
+        }
+        return result;
+    }
+
+    std::string string()
+    {
+        long long size = value();
+        if (size < 0 || _end - _pos < size) {
+            _valid = false;
+            return std::string();
+        }
+        std::string result(_pos, std::size_t(size));
+        _pos += size;
+        return result;
+    }
+
+    std::vector<hsize_t> dims()
+    {
+        long long size = value();
+        if (size < 0 || size > 32) {
+            _valid = false;
+            return std::vector<hsize_t>();
+        }
+        std::vector<hsize_t> result((std::size_t)size);
+        for (std::size_t n = 0; n < result.size(); ++n)
+            result[n] = hsize_t(value());
+        return result;
+    }
+
+private:
+    const char* _pos;
+    const char* _end;
+    bool        _valid;
+};
+
+static bool deserialize_nodes(const std::vector<char>& data, info_nodes_t& nodes)
+{
+    node_reader_t reader(data);
+    long long size = reader.value();
+    if (size <= 0 || size > (long long)data.size())
+        return false;
+
+    nodes.resize(std::size_t(size));
+    for (std::size_t n = 0; n < nodes.size() && reader.valid(); ++n) {
+        info_node_t& node = nodes[n];
+        node.kind = info_node_t::kind_t(reader.value());
+        node.name = reader.string();
+        node.num_contents = long(reader.value());
+        node.num_members = long(reader.value());
+
+        switch (node.kind) {
+        case info_node_t::OBJECT:
+            node.object.valid = true;
+            node.object.type = H5O_type_t(reader.value());
+            node.object.simple = reader.value() != 0;
+            node.object.rank = int(reader.value());
+            node.object.dims = reader.dims();
+            node.object.maxdims = reader.dims();
+            node.object.type_class = H5T_class_t(reader.value());
+            node.object.dtype = long(reader.value());
+            node.object.chunk = reader.dims();
+            if (node.object.rank > 0) {
+                std::size_t rank = std::size_t(node.object.rank);
+                if ((!node.object.dims.empty() && node.object.dims.size() != rank) ||
+                    node.object.maxdims.size() != node.object.dims.size() || 
+                    (!node.object.chunk.empty() && node.object.chunk.size() != rank))
+                    return false;
+            }
+            break;
+
+        case info_node_t::EXTERNAL_LINK:
+            node.filename = reader.string();
+            node.flags = unsigned(reader.value());
+            // fall through
+
+        case info_node_t::SOFT_LINK:
+            node.path = reader.string();
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    return reader.valid();
+}
+
+static DM::TagGroup do_info(const char* filename, const char* location, const DM::TagGroup& options)
+{
+    info_options_t info_options;
+    if (!parse_info_options(options, info_options))
+        return DM::TagGroup();
+
+    library_lock_t lock(filename);
+
+    // The index holds the listing of the whole file with default options
+    bool indexed = !options.IsValid() && strcmp(location, "/") == 0;
+    std::string path = normalize_path(filename);
+    info_nodes_t nodes;
+    std::vector<char> data;
+    if (indexed && load_info_index(path, data) && deserialize_nodes(data, nodes)) {
+        std::size_t pos = 0;
+        return tags_from_nodes(nodes, pos);
+    }
+
+    file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
+    if (!file.valid()) {
+        warning("h5_info: Can't open file '%s'.", filename);
+        return DM::TagGroup();
+    }
+
+    if (!get_object_info(file.get(), location, info_options, nodes))
+        return DM::TagGroup();
+
+    if (indexed) {
+        data.clear();
+        serialize_nodes(nodes, data);
+        store_info_index(path, data);
+    }
+
+    std::size_t pos = 0;
+    return tags_from_nodes(nodes, pos);
+}
+
 DM_TagGroupToken_1Ref h5_info_location(const char* filename, DM_StringToken location)
 {
     DM::TagGroup tags;
 
     PLUG_IN_ENTRY
 
-        file_handle_t file(H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT));
-        if (!file.valid()) {
-            warning("h5_info: Can't open file '%s'.", filename);
-            return NULL;
-        }
-
         std::string loc_name = to_UTF8(DM::String(location));
-        tags = get_object_info(file.get(), "", loc_name.c_str());
+        tags = do_info(filename, loc_name.c_str(), DM::TagGroup());
 
     PLUG_IN_EXIT
 
@@ -275,36 +956,251 @@ DM_TagGroupToken_1Ref h5_info_root(const char* filename)
 
     PLUG_IN_ENTRY
 
-        file_handle_t file(H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT));
-        if (!file.valid()) {
-            warning("h5_info: Can't open file '%s'.", filename);
-            return NULL;
-        }
+        tags = do_info(filename, "/", DM::TagGroup());
+
+    PLUG_IN_EXIT
+
+    return tags.release();
+}
+
+DM_TagGroupToken_1Ref h5_info_options(const char* filename, DM_StringToken location, DM_TagGroupToken options_token)
+{
+    DM::TagGroup tags;
+
+    PLUG_IN_ENTRY
 
-        tags = get_object_info(file.get(), "", "/");
+        std::string loc_name = to_UTF8(DM::String(location));
+        tags = do_info(filename, loc_name.c_str(), DM::TagGroup(options_token));
 
     PLUG_IN_EXIT
 
     return tags.release();
 }
 
+//----------------------------------------------------------------------------------------
+// Search for objects
+
+// Criteria of h5_find, read from the criteria TagGroup by parse_find_criteria()
+struct find_criteria_t
+{
+    std::vector<std::string> types;                 // Empty for all types
+    long                     dtype;                 // -1 for all
+    long                     min_rank, max_rank;    // -1 for no limit
+    std::vector<hsize_t>     min_size, max_size;    // Extents of the first dimensions (HDF5 order), empty for no limit
+    std::vector<std::string> attributes;            // Names of attributes, which must exist
+
+    find_criteria_t()
+    : dtype(-1), min_rank(-1), max_rank(-1)
+    {}
+
+    // Whether datasets must be opened to check the criteria
+    bool needs_details() const
+    {
+        return dtype >= 0 || min_rank >= 0 || max_rank >= 0 || !min_size.empty() || !max_size.empty();
+    }
+};
+
+/**
+ * Reads criteria of h5_find. Does not call the HDF5 library.
+ * @param criteria TagGroup with criteria, may be invalid.
+ * @param result OUT: Criteria.
+ * @returns Whether succeeded.
+ */
+static bool parse_find_criteria(const DM::TagGroup& criteria, find_criteria_t& result)
+{
+    if (!criteria.IsValid())
+        return true;
+
+    if (!parse_types("h5_find", criteria, result.types))
+        return false;
+
+    criteria.GetTagAsLong("DataType", &result.dtype);
+    criteria.GetTagAsLong("MinRank", &result.min_rank);
+    criteria.GetTagAsLong("MaxRank", &result.max_rank);
+
+    DM::TagGroup size_tags;
+    if (criteria.GetTagAsTagGroup("MinSize", &size_tags))
+        result.min_size = hsize_array_from_taglist(size_tags);
+    if (criteria.GetTagAsTagGroup("MaxSize", &size_tags))
+        result.max_size = hsize_array_from_taglist(size_tags);
+
+    DM::TagGroup attr_tags;
+    if (criteria.GetTagAsTagGroup("Attributes", &attr_tags)) {
+        long count = attr_tags.CountTags();
+        for (long n = 0; n < count; ++n) {
+            DM::String name;
+            if (!attr_tags.GetIndexedTagAsString(n, &name)) {
+                warning("h5_find: Attributes must be tag list of strings.");
+                return false;
+            }
+            result.attributes.push_back(to_UTF8(name));
+        }
+    }
+
+    return true;
+}
+
+// Returns whether name matches pattern with wildcards '*' (any characters) and '?' (one character).
+static bool glob_match(const char* pattern, const char* name)
+{
+    const char* star = NULL;
+    const char* retry = NULL;
+    while (*name) {
+        if (*pattern == '*') {
+            star = ++pattern;
+            retry = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            ++pattern;
+            ++name;
+        } else if (star) {
+            pattern = star;
+            name = ++retry;
+        } else
+            return false;
+    }
+
+    while (*pattern == '*')
+        ++pattern;
+    return *pattern == 0;
+}
+
+// Returns whether extents (HDF5 order) satisfy the limits of the first dimensions (DM order).
+static bool size_in_range(const std::vector<hsize_t>& dims, const std::vector<hsize_t>& limits, bool upper)
+{
+    if (limits.empty())
+        return true;
+    if (dims.size() < limits.size())
+        return false;
+
+    std::size_t first = dims.size() - limits.size();
+    for (std::size_t n = 0; n < limits.size(); ++n)
+        if (upper ? dims[first + n] > limits[n] : dims[first + n] < limits[n])
+            return false;
+
+    return true;
+}
+
+static bool node_matches(hid_t file_id, const info_node_t& node, const std::string& pattern, const find_criteria_t& criteria)
+{
+    // Without '/' the pattern applies to the last part of the name
+    const char* name = node.name.c_str();
+    if (pattern.find('/') == std::string::npos) {
+        const char* slash = strrchr(name, '/');
+        name = slash ? slash + 1 : name;
+    }
+    if (!glob_match(pattern.c_str(), name))
+        return false;
+
+    const char* type = node.kind == info_node_t::SOFT_LINK ? "SoftLink" :
+                       node.kind == info_node_t::EXTERNAL_LINK ? "ExternalLink" : object_type_name(node.object.type);
+    if (!criteria.types.empty() && !type_in_list(criteria.types, type))
+        return false;
+
+    if (criteria.needs_details()) {
+        const object_info_t& object = node.object;
+        if (node.kind != info_node_t::OBJECT || object.type != H5O_TYPE_DATASET || object.type_class == H5T_NO_CLASS)
+            return false;
+        if (criteria.dtype >= 0 && object.dtype != criteria.dtype)
+            return false;
+        if ((criteria.min_rank >= 0 && object.rank < criteria.min_rank) || (criteria.max_rank >= 0 && object.rank > criteria.max_rank))
+            return false;
+        if (!size_in_range(object.dims, criteria.min_size, false) || !size_in_range(object.dims, criteria.max_size, true))
+            return false;
+    }
+
+    if (!criteria.attributes.empty()) {
+        if (node.kind != info_node_t::OBJECT)
+            return false;
+        for (std::size_t n = 0; n < criteria.attributes.size(); ++n)
+            if (H5Aexists_by_name(file_id, node.name.c_str(), criteria.attributes[n].c_str(), H5P_DEFAULT) <= 0)
+                return false;
+    }
+
+    return true;
+}
+
+static DM::TagGroup do_find(const char* filename, DM_StringToken root, DM_StringToken pattern, const DM::TagGroup& criteria)
+{
+    find_criteria_t find_criteria;
+    if (!parse_find_criteria(criteria, find_criteria))
+        return DM::TagGroup();
+
+    std::string root_name = to_UTF8(DM::String(root));
+    std::string pattern_str = to_UTF8(DM::String(pattern));
+    if (pattern_str.empty())
+        pattern_str = "*";
+
+    library_lock_t lock(filename);
+    file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
+    if (!file.valid()) {
+        warning("h5_find: Can't open file '%s'.", filename);
+        return DM::TagGroup();
+    }
+
+    // Datasets are only opened, if the criteria need their properties
+    info_options_t options;
+    options.details = find_criteria.needs_details();
+    info_nodes_t nodes;
+    if (!get_object_info(file.get(), root_name.c_str(), options, nodes)) {
+        warning("h5_find: Can't find object '%s'.", root_name.c_str());
+        return DM::TagGroup();
+    }
+
+    DM::TagGroup paths = DM::NewTagList();
+    for (std::size_t n = 0; n < nodes.size(); ++n)
+        if (node_matches(file.get(), nodes[n], pattern_str, find_criteria))
+            paths.InsertTagAsString(-1, from_UTF8(nodes[n].name));
+
+    return paths;
+}
+
+DM_TagGroupToken_1Ref h5_find_pattern(const char* filename, DM_StringToken root, DM_StringToken pattern)
+{
+    DM::TagGroup paths;
+
+    PLUG_IN_ENTRY
+
+        paths = do_find(filename, root, pattern, DM::TagGroup());
+
+    PLUG_IN_EXIT
+
+    return paths.release();
+}
+
+DM_TagGroupToken_1Ref h5_find_criteria(const char* filename, DM_StringToken root, DM_StringToken pattern, DM_TagGroupToken criteria_token)
+{
+    DM::TagGroup paths;
+
+    PLUG_IN_ENTRY
+
+        paths = do_find(filename, root, pattern, DM::TagGroup(criteria_token));
+
+    PLUG_IN_EXIT
+
+    return paths.release();
+}
+
 bool h5_delete(const char* filename, DM_StringToken location)
 {
     PLUG_IN_ENTRY
 
-        file_handle_t file(H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT));
+        library_lock_t lock(filename);
+        file_handle_t file = open_file(filename, H5F_ACC_RDWR);
         if (!file.valid()) {
             warning("h5_delete: Can't open file '%s'.", filename);
             return NULL;
         }
 
         std::string loc_name = to_UTF8(DM::String(location));
+        forget_cached_datasets(file.get());
         if (H5Ldelete(file.get(), loc_name.c_str(), H5P_DEFAULT) < 0) {
             warning("h5_delete: Error deleting object '%s'.", loc_name.c_str());
             dump_HDF_error_stack();
             return false;
         }
 
+        flush_file(file.get());
+
     PLUG_IN_EXIT
 
     return true;
@@ -316,7 +1212,8 @@ bool h5_exists(const char* filename, DM_StringToken location)
 
     PLUG_IN_ENTRY
 
-        file_handle_t file(H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT));
+        library_lock_t lock(filename);
+        file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
         if (!file.valid()) {
             warning("h5_exists: Can't open file '%s'.", filename);
             return NULL;
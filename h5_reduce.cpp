@@ -0,0 +1,335 @@
+#include "plugin.h"
+#include "threads.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace Gatan;
+
+// Bytes of frames read at once, two tiles are held in memory
+static const hsize_t max_tile_bytes = 64 * 1024 * 1024;
+
+// Frames processed by one index of the reduce task
+static const std::size_t frames_per_index = 16;
+
+namespace {
+
+template <typename T>
+double dot_frame(const T* frame, const double* mask, std::size_t size)
+{
+    double sum = 0;
+    for (std::size_t n = 0; n < size; ++n)
+        sum += double(frame[n]) * mask[n];
+    return sum;
+}
+
+/**
+ * Dots the frames of a tile with all masks.
+ */
+struct reduce_task_t : public worker_pool_t::task_t
+{
+    long                        dtype;
+    std::size_t                 elemsize;
+    std::size_t                 frame_size;     // Elements per frame
+    const std::vector<double>&  masks;          // num_masks * frame_size
+    std::size_t                 num_masks;
+    const std::vector<hsize_t>& scan;           // Scan extent (HDF5 order)
+    double*                     output;         // num_masks * scan size
+
+    // Tile being processed
+    const char*                 frames;
+    std::vector<hsize_t>        origin;         // Scan position of first frame
+    std::vector<hsize_t>        count;          // Scan extent of tile
+    std::size_t                 num_frames;
+
+    reduce_task_t(long _dtype, std::size_t _frame_size, const std::vector<double>& _masks, std::size_t _num_masks,
+                  const std::vector<hsize_t>& _scan, double* _output)
+    : dtype(_dtype), elemsize(0), frame_size(_frame_size), masks(_masks), num_masks(_num_masks), scan(_scan),
+      output(_output), frames(NULL), num_frames(0)
+    {
+        type_handle_t type = datatype_to_HDF(dtype);
+        elemsize = H5Tget_size(type.get());
+    }
+
+    std::size_t num_indices() const
+    {
+        return (num_frames + frames_per_index - 1) / frames_per_index;
+    }
+
+    bool run(std::size_t index)
+    {
+        std::size_t scan_size = 1;
+        for (std::size_t n = 0; n < scan.size(); ++n)
+            scan_size *= std::size_t(scan[n]);
+
+        std::size_t end = std::min(num_frames, (index + 1) * frames_per_index);
+        for (std::size_t f = index * frames_per_index; f < end; ++f) {
+            // Position of frame in scan
+            std::size_t pos = 0, rest = f, tile_stride = num_frames;
+            for (std::size_t n = 0; n < scan.size(); ++n) {
+                tile_stride /= std::size_t(count[n]);
+                pos = pos * std::size_t(scan[n]) + std::size_t(origin[n]) + rest / tile_stride;
+                rest %= tile_stride;
+            }
+
+            const char* frame = frames + f * frame_size * elemsize;
+            for (std::size_t m = 0; m < num_masks; ++m) {
+                const double* mask = &masks[m * frame_size];
+                double value;
+                switch (dtype) {
+                case ImageData::SIGNED_INT8_DATA:       value = dot_frame(reinterpret_cast<const signed char*>(frame), mask, frame_size); break;
+                case ImageData::SIGNED_INT16_DATA:      value = dot_frame(reinterpret_cast<const short*>(frame), mask, frame_size); break;
+                case ImageData::SIGNED_INT32_DATA:      value = dot_frame(reinterpret_cast<const int*>(frame), mask, frame_size); break;
+                case undocumented_SIGNED_INT64_DATA:    value = dot_frame(reinterpret_cast<const long long*>(frame), mask, frame_size); break;
+                case ImageData::UNSIGNED_INT8_DATA:     value = dot_frame(reinterpret_cast<const unsigned char*>(frame), mask, frame_size); break;
+                case ImageData::UNSIGNED_INT16_DATA:    value = dot_frame(reinterpret_cast<const unsigned short*>(frame), mask, frame_size); break;
+                case ImageData::UNSIGNED_INT32_DATA:    value = dot_frame(reinterpret_cast<const unsigned int*>(frame), mask, frame_size); break;
+                case undocumented_UNSIGNED_INT64_DATA:  value = dot_frame(reinterpret_cast<const unsigned long long*>(frame), mask, frame_size); break;
+                case ImageData::REAL4_DATA:             value = dot_frame(reinterpret_cast<const float*>(frame), mask, frame_size); break;
+                case ImageData::REAL8_DATA:             value = dot_frame(reinterpret_cast<const double*>(frame), mask, frame_size); break;
+                default:                                return false;
+                }
+                output[m * scan_size + pos] = value;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * Reads dimension list of h5_reduce().
+ * @param dims OUT: DM dimension indices in increasing order.
+ */
+bool dims_from_taglist(const char* name, DM_TagGroupToken token, std::vector<long>& dims)
+{
+    DM::TagGroup tags(token);
+    if (!tags.IsValid() || !tags.IsList()) {
+        warning("h5_reduce: %s must be tag list.", name);
+        return false;
+    }
+
+    dims.resize(tags.CountTags());
+    for (std::size_t n = 0; n < dims.size(); ++n)
+        if (!tags.GetIndexedTagAsLong(long(n), &dims[n])) {
+            warning("h5_reduce: %s must be numbers.", name);
+            return false;
+        }
+    std::sort(dims.begin(), dims.end());
+    return true;
+}
+
+/**
+ * Reads a tile of frames.
+ * @param origin, count Scan position and extent of tile (HDF5 order).
+ * @param frame Extent of frames (HDF5 order).
+ */
+bool read_tile(hid_t dset_id, hid_t space_id, hid_t memtype_id, const std::vector<hsize_t>& origin,
+               const std::vector<hsize_t>& count, const std::vector<hsize_t>& frame, std::vector<char>& buffer)
+{
+    std::vector<hsize_t> offset(origin), extent(count), stride(origin.size() + frame.size(), 1);
+    offset.resize(stride.size(), 0);
+    extent.insert(extent.end(), frame.begin(), frame.end());
+
+    hsize_t bytes = H5Tget_size(memtype_id);
+    for (std::size_t n = 0; n < extent.size(); ++n)
+        bytes *= extent[n];
+    buffer.resize(std::size_t(bytes));
+
+    // Each tile is read once, so it must not evict the chunks cached for slices
+    if (read_chunks_parallel(dset_id, memtype_id, &offset[0], &stride[0], &extent[0], &buffer[0], false))
+        return true;
+
+    space_handle_t memspace(H5Screate_simple(int(extent.size()), &extent[0], NULL));
+    return memspace.valid()
+        && H5Sselect_hyperslab(space_id, H5S_SELECT_SET, &offset[0], NULL, &extent[0], NULL) >= 0
+        && H5Dread(dset_id, memtype_id, memspace.get(), space_id, H5P_DEFAULT, &buffer[0]) >= 0;
+}
+
+/**
+ * Advances scan position to next tile.
+ * @returns false after the last tile.
+ */
+bool next_tile(const std::vector<hsize_t>& scan, const std::vector<hsize_t>& tile, std::vector<hsize_t>& origin, std::vector<hsize_t>& count)
+{
+    for (std::size_t n = scan.size(); n-- > 0; ) {
+        origin[n] += tile[n];
+        if (origin[n] < scan[n]) {
+            for (std::size_t i = n; i < scan.size(); ++i)
+                count[i] = std::min(tile[i], scan[i] - origin[i]);
+            return true;
+        }
+        origin[n] = 0;
+    }
+    return false;
+}
+
+DM::Image do_reduce(const char* filename, DM_StringToken location, DM::Image masks, DM_TagGroupToken scan_token, DM_TagGroupToken detector_token)
+{
+    std::vector<long> scan_dims, detector_dims;
+    if (!dims_from_taglist("scan dimensions", scan_token, scan_dims) || !dims_from_taglist("detector dimensions", detector_token, detector_dims))
+        return DM::Image();
+
+    if (!masks.IsValid()) {
+        warning("h5_reduce: Invalid mask image.");
+        return DM::Image();
+    }
+
+    library_lock_t lock(filename);
+    file_handle_t file = open_file(filename, H5F_ACC_RDONLY);
+    if (!file.valid()) {
+        warning("h5_reduce: Can't open file '%s'.", filename);
+        return DM::Image();
+    }
+
+    std::string loc_name = to_UTF8(DM::String(location));
+    dataset_handle_t data = open_dataset(file.get(), loc_name.c_str());
+    if (!data.valid()) {
+        warning("h5_reduce: Invalid location '%s'.", loc_name.c_str());
+        return DM::Image();
+    }
+
+    space_handle_t space(H5Dget_space(data.get()));
+    type_handle_t type(H5Dget_type(data.get()));
+    std::vector<hsize_t> dims;
+    if (!space.valid() || !type.valid() || hsize_array_from_HDF5(space.get(), dims) < 0) {
+        warning("h5_reduce: Reading data space or type failed.");
+        dump_HDF_error_stack();
+        return DM::Image();
+    }
+
+    long dtype = datatype_from_HDF(type.get());
+    if (dtype < 0 || dtype == ImageData::COMPLEX8_DATA || dtype == ImageData::COMPLEX16_DATA) {
+        warning("h5_reduce: Unsupported array type.");
+        return DM::Image();
+    }
+
+    // Frames must be contiguous: detector dimensions first, scan dimensions last (DM order)
+    std::size_t rank = dims.size(), num_detector = detector_dims.size(), num_scan = scan_dims.size();
+    bool valid = num_detector > 0 && num_scan > 0 && num_detector + num_scan == rank;
+    for (std::size_t n = 0; valid && n < num_detector; ++n)
+        valid = detector_dims[n] == long(n);
+    for (std::size_t n = 0; valid && n < num_scan; ++n)
+        valid = scan_dims[n] == long(num_detector + n);
+    if (!valid) {
+        warning("h5_reduce: Detector dimensions must be the first and scan dimensions the remaining dimensions of the dataset.");
+        return DM::Image();
+    }
+
+    std::vector<hsize_t> scan(dims.begin(), dims.begin() + num_scan), frame(dims.begin() + num_scan, dims.end());
+    if (num_scan > 3) {
+        warning("h5_reduce: At most 3 scan dimensions are supported.");
+        return DM::Image();
+    }
+
+    // Masks have the extent of the frames, an additional dimension stacks masks
+    std::size_t mask_rank = std::size_t(masks.GetNumDimensions());
+    std::vector<hsize_t> mask_dims(mask_rank);
+    for (std::size_t n = 0; n < mask_rank; ++n)
+        mask_dims[mask_rank - 1 - n] = masks.GetDimensionSize(long(n));
+    std::size_t num_masks = 1;
+    bool stacked = mask_rank == num_detector + 1;
+    if (stacked) {
+        num_masks = std::size_t(mask_dims[0]);
+        mask_dims.erase(mask_dims.begin());
+    }
+    if (mask_dims != frame) {
+        warning("h5_reduce: Mask must have the extent of the detector dimensions.");
+        return DM::Image();
+    }
+
+    std::size_t frame_size = 1;
+    for (std::size_t n = 0; n < frame.size(); ++n)
+        frame_size *= std::size_t(frame[n]);
+
+    std::vector<double> mask_values(num_masks * frame_size);
+    {
+        type_handle_t mask_type = datatype_to_HDF(masks.GetDataType());
+        PlugIn::ImageDataLocker maskLock(masks, PlugIn::ImageDataLocker::lock_data_WONT_WRITE
+                                              | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+        std::size_t mask_bytes = mask_type.valid() ? H5Tget_size(mask_type.get()) : 0;
+        std::vector<char> converted(mask_values.size() * std::max<std::size_t>(mask_bytes, sizeof(double)));
+        if (mask_bytes)
+            memcpy(&converted[0], maskLock.get(), mask_values.size() * mask_bytes);
+        if (!mask_bytes || H5Tconvert(mask_type.get(), H5T_NATIVE_DOUBLE, mask_values.size(), &converted[0], NULL, H5P_DEFAULT) < 0) {
+            warning("h5_reduce: Unsupported mask type.");
+            return DM::Image();
+        }
+        memcpy(&mask_values[0], &converted[0], mask_values.size() * sizeof(double));
+    }
+
+    // Result has the scan dimensions and one plane per mask
+    std::vector<hsize_t> result_dims(scan);
+    if (stacked)
+        result_dims.insert(result_dims.begin(), num_masks);
+    DM::Image result = create_image(ImageData::REAL8_DATA, int(result_dims.size()), &result_dims[0]);
+    if (!result.IsValid()) {
+        warning("h5_reduce: Can't create image.");
+        return DM::Image();
+    }
+
+    // Tiles are whole chunks in the scan dimensions, several chunks along the innermost
+    type_handle_t memtype = datatype_to_HDF(dtype);
+    hsize_t frame_bytes = H5Tget_size(memtype.get()) * frame_size;
+    std::vector<hsize_t> tile(num_scan, 1);
+    plist_handle_t dcpl(H5Dget_create_plist(data.get()));
+    if (dcpl.valid() && H5Pget_layout(dcpl.get()) == H5D_CHUNKED) {
+        std::vector<hsize_t> chunk(rank);
+        if (H5Pget_chunk(dcpl.get(), int(rank), &chunk[0]) == int(rank))
+            std::copy(chunk.begin(), chunk.begin() + num_scan, tile.begin());
+    }
+    hsize_t tile_bytes = frame_bytes;
+    for (std::size_t n = 0; n < num_scan; ++n)
+        tile_bytes *= tile[n];
+    tile[num_scan - 1] *= std::max<hsize_t>(1, max_tile_bytes / tile_bytes);
+    for (std::size_t n = 0; n < num_scan; ++n)
+        tile[n] = std::min(tile[n], scan[n]);
+
+    bool success = true;
+    {
+        PlugIn::ImageDataLocker resultLock(result, PlugIn::ImageDataLocker::lock_data_WONT_READ
+                                                 | PlugIn::ImageDataLocker::lock_data_CONTIGUOUS);
+        reduce_task_t task(dtype, frame_size, mask_values, num_masks, scan, static_cast<double*>(resultLock.get()));
+        worker_pool_t& pool = get_worker_pool();
+        worker_pool_t::job_t job;
+
+        // While one tile is reduced, the next is read
+        std::vector<char> buffers[2];
+        std::vector<hsize_t> origin(num_scan, 0), count(tile);
+        bool more = read_tile(data.get(), space.get(), memtype.get(), origin, count, frame, buffers[0]);
+        success = more;
+        for (std::size_t t = 0; more; ++t) {
+            task.frames = &buffers[t % 2][0];
+            task.origin = origin;
+            task.count = count;
+            task.num_frames = std::size_t(buffers[t % 2].size() / frame_bytes);
+            pool.start(job, task, task.num_indices());
+
+            more = next_tile(scan, tile, origin, count);
+            if (more && !read_tile(data.get(), space.get(), memtype.get(), origin, count, frame, buffers[(t + 1) % 2]))
+                success = more = false;
+            success = pool.wait(job) && success;
+        }
+        result.DataChanged();
+    }
+    if (!success) {
+        warning("h5_reduce: Reading of dataset failed.");
+        dump_HDF_error_stack();
+        return DM::Image();
+    }
+
+    return result;
+}
+
+} // namespace
+
+DM_ImageToken_1Ref h5_reduce(const char* filename, DM_StringToken location, DM_ImageToken masks_token, DM_TagGroupToken scan_token, DM_TagGroupToken detector_token)
+{
+    DM::Image image;
+
+    PLUG_IN_ENTRY
+
+        image = do_reduce(filename, location, DM::Image(masks_token), scan_token, detector_token);
+
+    PLUG_IN_EXIT
+
+    return image.release();
+}
@@ -0,0 +1,140 @@
+#include "plugin.h"
+#include <windows.h>
+#include <stdio.h>
+#include <ctype.h>
+
+using namespace Gatan;
+
+static const char          index_magic[8] = { 'H', '5', 'I', 'N', 'F', 'O', 'I', 'X' };
+static const unsigned long index_version = 1;
+
+// Directory of index files, empty if indices are disabled. Guarded by the library lock.
+static std::string index_directory;
+
+// Returns name of index file of path, FNV-1a hash of the case folded path.
+static std::string index_filename(const std::string& path)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (std::size_t n = 0; n < path.size(); ++n) {
+        hash ^= (unsigned char)tolower((unsigned char)path[n]);
+        hash *= 1099511628211ULL;
+    }
+
+    std::string name;
+    for (int shift = 60; shift >= 0; shift -= 4)
+        name += "0123456789abcdef"[(hash >> shift) & 15];
+    return index_directory + '\\' + name + ".h5info";
+}
+
+static void append_raw(std::vector<char>& data, const void* value, std::size_t size)
+{
+    const char* bytes = static_cast<const char*>(value);
+    data.insert(data.end(), bytes, bytes + size);
+}
+
+bool load_info_index(const std::string& path, std::vector<char>& data)
+{
+    if (index_directory.empty())
+        return false;
+
+    file_stamp_t stamp;
+    if (!get_file_stamp(path, stamp))
+        return false;
+
+    FILE* file = fopen(index_filename(path).c_str(), "rb");
+    if (!file)
+        return false;
+
+    // One sequential read of the whole index
+    std::vector<char> buffer;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size > 0) {
+        buffer.resize(size);
+        if (fread(&buffer[0], 1, buffer.size(), file) != buffer.size())
+            buffer.clear();
+    }
+    fclose(file);
+
+    // Header: magic, version, stamp, length and characters of path
+    std::size_t header_size = sizeof(index_magic) + sizeof(unsigned long) + sizeof(file_stamp_t) + sizeof(unsigned long);
+    if (buffer.size() < header_size || memcmp(&buffer[0], index_magic, sizeof(index_magic)) != 0)
+        return false;
+
+    const char* pos = &buffer[sizeof(index_magic)];
+    unsigned long version, path_length;
+    file_stamp_t index_stamp;
+    memcpy(&version, pos, sizeof(version));
+    pos += sizeof(version);
+    memcpy(&index_stamp, pos, sizeof(index_stamp));
+    pos += sizeof(index_stamp);
+    memcpy(&path_length, pos, sizeof(path_length));
+    pos += sizeof(path_length);
+
+    // The file changed or the hash collides with another file
+    if (version != index_version || index_stamp != stamp || buffer.size() < header_size + path_length ||
+        _strnicmp(pos, path.c_str(), path_length) != 0 || path.size() != path_length)
+        return false;
+
+    pos += path_length;
+    data.assign(buffer.begin() + (pos - &buffer[0]), buffer.end());
+    return true;
+}
+
+void store_info_index(const std::string& path, const std::vector<char>& data)
+{
+    if (index_directory.empty())
+        return;
+
+    file_stamp_t stamp;
+    if (!get_file_stamp(path, stamp))
+        return;
+
+    std::vector<char> buffer;
+    unsigned long path_length = (unsigned long)path.size();
+    append_raw(buffer, index_magic, sizeof(index_magic));
+    append_raw(buffer, &index_version, sizeof(index_version));
+    append_raw(buffer, &stamp, sizeof(stamp));
+    append_raw(buffer, &path_length, sizeof(path_length));
+    buffer.insert(buffer.end(), path.begin(), path.end());
+    buffer.insert(buffer.end(), data.begin(), data.end());
+
+    // Written to a temporary file first, so readers never see a partial index
+    std::string filename = index_filename(path);
+    std::string tmp_filename = filename + ".tmp";
+    FILE* file = fopen(tmp_filename.c_str(), "wb");
+    if (!file)
+        return;
+
+    bool written = fwrite(&buffer[0], 1, buffer.size(), file) == buffer.size();
+    written = fclose(file) == 0 && written;
+    if (!written || !MoveFileExA(tmp_filename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+        DeleteFileA(tmp_filename.c_str());
+}
+
+void invalidate_info_index(const std::string& path)
+{
+    if (!index_directory.empty())
+        DeleteFileA(index_filename(path).c_str());
+}
+
+bool h5_set_info_index(const char* directory)
+{
+    PLUG_IN_ENTRY
+
+        library_lock_t lock;
+        if (*directory) {
+            DWORD attributes = GetFileAttributesA(directory);
+            if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                warning("h5_set_info_index: '%s' is not a directory.", directory);
+                return false;
+            }
+            index_directory = normalize_path(directory);
+        } else
+            index_directory.clear();
+
+    PLUG_IN_EXIT
+
+    return true;
+}
@@ -21,6 +21,7 @@ DM_StringToken_1Ref h5_version(void)
 
 bool h5_is_file(const char* filename)
 {
+    library_lock_t lock(filename);
     return H5Fis_hdf5(filename) > 0;
 }
 
@@ -31,20 +32,70 @@ void HDF5Plugin::Start()
 
     AddFunction("TagGroup h5_info(string filename)", &h5_info_root);
     AddFunction("TagGroup h5_info(string filename, dm_string location)", &h5_info_location);
+    AddFunction("TagGroup h5_info(string filename, dm_string location, TagGroup options)", &h5_info_options);
+    AddFunction("TagGroup h5_find(string filename, dm_string root, dm_string pattern)", &h5_find_pattern);
+    AddFunction("TagGroup h5_find(string filename, dm_string root, dm_string pattern, TagGroup criteria)", &h5_find_criteria);
     AddFunction("bool h5_delete(string filename, dm_string location)", &h5_delete);
     AddFunction("bool h5_exists(string filename, dm_string location)", &h5_exists);
 
     AddFunction("TagGroup h5_read_attr(string filename, dm_string location)", &h5_read_attr);
+    AddFunction("TagGroup h5_read_attr(string filename, dm_string location, long image_threshold)", &h5_read_attr_threshold);
+    AddFunction("TagGroup h5_read_attr(string filename, dm_string location, TagGroup names)", &h5_read_attr_names);
+    AddFunction("ImageRef h5_read_attr_array(string filename, dm_string location, dm_string attr)", &h5_read_attr_array);
+    AddFunction("TagGroup h5_read_attr_tree(string filename, dm_string root, long depth)", &h5_read_attr_tree);
     AddFunction("bool h5_delete_attr(string filename, dm_string location, dm_string attr)", &h5_delete_attr);
     AddFunction("bool h5_exists_attr(string filename, dm_string location, dm_string attr)", &h5_exists_attr);
 
     AddFunction("bool h5_create_dataset(string filename, dm_string location, Image* data)", &h5_create_dataset_from_image);
     AddFunction("bool h5_create_dataset(string filename, dm_string location, long dtype, TagGroup size)", &h5_create_dataset_simple);
+    AddFunction("bool h5_create_dataset(string filename, dm_string location, Image* data, TagGroup options)", &h5_create_dataset_from_image_opt);
+    AddFunction("bool h5_create_dataset(string filename, dm_string location, long dtype, TagGroup size, TagGroup options)", &h5_create_dataset_simple_opt);
+    AddFunction("bool h5_create_appendable_dataset(string filename, dm_string location, long dtype, TagGroup frame_size)", &h5_create_appendable_dataset);
+    AddFunction("bool h5_create_appendable_dataset(string filename, dm_string location, long dtype, TagGroup frame_size, TagGroup options)", &h5_create_appendable_dataset_opt);
+    AddFunction("bool h5_append(string filename, dm_string location, Image* data)", &h5_append);
     AddFunction("ImageRef h5_read_dataset(string filename, dm_string location)", &h5_read_dataset_all);
+    AddFunction("ImageRef h5_read_dataset_slice(string filename, dm_string location, TagGroup offsets, TagGroup dims, TagGroup counts, TagGroup strides)", &h5_read_dataset_slice);
+    AddFunction("ImageRef h5_read_dataset_slice(string filename, dm_string location, TagGroup offsets, TagGroup dims, TagGroup counts, TagGroup strides, TagGroup blocks)", &h5_read_dataset_slice_blocks);
+    AddFunction("ImageRef h5_read_dataset_points(string filename, dm_string location, Image* coords)", &h5_read_dataset_points);
+    AddFunction("ImageRef h5_read_dataset_points(string filename, dm_string location, TagGroup coords)", &h5_read_dataset_points_list);
+    AddFunction("ImageRef h5_reduce(string filename, dm_string location, Image* masks, TagGroup scan_dims, TagGroup detector_dims)", &h5_reduce);
+    AddFunction("ImageRef h5_read_dataset_binned(string filename, dm_string location, TagGroup offsets, TagGroup dims, TagGroup counts, TagGroup bins, string mode)", &h5_read_dataset_binned);
+    AddFunction("bool h5_read_dataset_into(string filename, dm_string location, Image* dest)", &h5_read_dataset_into);
+    AddFunction("bool h5_read_dataset_into(string filename, dm_string location, Image* dest, TagGroup dest_offsets)", &h5_read_dataset_into_offset);
+    AddFunction("bool h5_read_dataset_into(string filename, dm_string location, Image* dest, TagGroup dest_offsets, TagGroup offsets, TagGroup dims, TagGroup counts, TagGroup strides)", &h5_read_dataset_slice_into);
     AddFunction("ImageRef h5_read_dataset_slice1(string filename, dm_string location, TagGroup offsets, long dim0, long count0, long stride0)", &h5_read_dataset_slice1);
     AddFunction("ImageRef h5_read_dataset_slice2(string filename, dm_string location, TagGroup offsets, long dim0, long count0, long stride0, long dim1, long count1, long stride1)", &h5_read_dataset_slice2);
     AddFunction("ImageRef h5_read_dataset_slice3(string filename, dm_string location, TagGroup offsets, long dim0, long count0, long stride0, long dim1, long count1, long stride1, long dim1, long count2, long stride2)", &h5_read_dataset_slice3);
+    AddFunction("bool h5_write_dataset_slice(string filename, dm_string location, TagGroup offsets, Image* data)", &h5_write_dataset_slice);
+    AddFunction("bool h5_write_dataset_slice(string filename, dm_string location, TagGroup offsets, Image* data, long dim0, long stride0)", &h5_write_dataset_slice1);
+    AddFunction("bool h5_write_dataset_slice(string filename, dm_string location, TagGroup offsets, Image* data, long dim0, long stride0, long dim1, long stride1)", &h5_write_dataset_slice2);
+    AddFunction("bool h5_write_dataset_slice(string filename, dm_string location, TagGroup offsets, Image* data, long dim0, long stride0, long dim1, long stride1, long dim2, long stride2)", &h5_write_dataset_slice3);
     AddFunction("dm_string h5_read_string_dataset(string filename, dm_string location)", &h5_read_string_dataset);
+    AddFunction("void h5_set_direct_read(bool enable)", &h5_set_direct_read);
+
+    AddFunction("bool h5_open(string filename)", &h5_open_readonly);
+    AddFunction("bool h5_open(string filename, bool writable)", &h5_open);
+    AddFunction("bool h5_close(string filename)", &h5_close);
+    AddFunction("void h5_close_all()", &h5_close_all);
+    AddFunction("bool h5_flush(string filename)", &h5_flush);
+    AddFunction("void h5_set_file_cache_size(long size)", &h5_set_file_cache_size);
+    AddFunction("TagGroup h5_file_cache_stats()", &h5_file_cache_stats);
+    AddFunction("bool h5_set_cache_config(TagGroup config)", &h5_set_cache_config);
+    AddFunction("TagGroup h5_get_cache_config()", &h5_get_cache_config);
+    AddFunction("void h5_set_num_threads(long num)", &h5_set_num_threads);
+    AddFunction("void h5_set_readahead(long frames)", &h5_set_readahead);
+    AddFunction("void h5_set_async_write(bool enable)", &h5_set_async_write);
+    AddFunction("bool h5_set_info_index(string directory)", &h5_set_info_index);
+    AddFunction("bool h5_wait()", &h5_wait);
+    AddFunction("long h5_pending()", &h5_pending);
+
+#if !H5_VERSION_GE(1, 10, 3)
+    warning("HDF5 %d.%d.%d is too old, parallel chunk I/O, the decoded chunk cache, readahead and chunk statistics are disabled. Use HDF5 1.10.5 or newer.",
+            H5_VERS_MAJOR, H5_VERS_MINOR, H5_VERS_RELEASE);
+#elif !H5_VERSION_GE(1, 10, 5)
+    warning("HDF5 %d.%d.%d is too old, parallel chunk reading, the decoded chunk cache, readahead and chunk statistics are disabled. Use HDF5 1.10.5 or newer.",
+            H5_VERS_MAJOR, H5_VERS_MINOR, H5_VERS_RELEASE);
+#endif
 }
 
 ///
@@ -81,6 +132,10 @@ void HDF5Plugin::Cleanup()
 ///
 void HDF5Plugin::End()
 {
+    stop_readahead();
+    stop_write_queue();
+    stop_worker_pool();
+    close_file_cache();
 }
 
 HDF5Plugin gHDF5PlugIn;
@@ -11,6 +11,19 @@
 #include "autohandle.h"
 #include <vector>
 
+// Not defined by HDF5 versions before 1.8.7
+#ifndef H5_VERSION_GE
+#   define H5_VERSION_GE(Maj, Min, Rel) \
+        (((H5_VERS_MAJOR == Maj) && (H5_VERS_MINOR == Min) && (H5_VERS_RELEASE >= Rel)) || \
+         ((H5_VERS_MAJOR == Maj) && (H5_VERS_MINOR > Min)) || \
+         (H5_VERS_MAJOR > Maj))
+#endif
+
+// Object and link traversal use the 1.10 API (H5O_info_t::addr, H5L_info_t::u.address)
+#if H5_VERSION_GE(1, 12, 0) && !defined(H5_USE_110_API) && !defined(H5_USE_110_API_DEFAULT)
+#   error "HDF5 1.12 or newer requires H5_USE_110_API."
+#endif
+
 // GMS version defined?
 #ifndef GMS_VERSION_MAJOR
 #   error "GMS_VERSION_MAJOR not defined."
@@ -45,20 +58,390 @@ private:
 
 DM_TagGroupToken_1Ref h5_info_root(const char* filename);
 DM_TagGroupToken_1Ref h5_info_location(const char* filename, DM_StringToken location);
+DM_TagGroupToken_1Ref h5_info_options(const char* filename, DM_StringToken location, DM_TagGroupToken options);
+DM_TagGroupToken_1Ref h5_find_pattern(const char* filename, DM_StringToken root, DM_StringToken pattern);
+DM_TagGroupToken_1Ref h5_find_criteria(const char* filename, DM_StringToken root, DM_StringToken pattern, DM_TagGroupToken criteria);
 bool                  h5_delete(const char* filename, DM_StringToken location);
 bool                  h5_exists(const char* filename, DM_StringToken location);
 
 DM_TagGroupToken_1Ref h5_read_attr(const char* filename, DM_StringToken location);
+DM_TagGroupToken_1Ref h5_read_attr_threshold(const char* filename, DM_StringToken location, long image_threshold);
+DM_TagGroupToken_1Ref h5_read_attr_names(const char* filename, DM_StringToken location, DM_TagGroupToken names);
+DM_ImageToken_1Ref    h5_read_attr_array(const char* filename, DM_StringToken location, DM_StringToken name);
+DM_TagGroupToken_1Ref h5_read_attr_tree(const char* filename, DM_StringToken root, long depth);
 bool                  h5_delete_attr(const char* filename, DM_StringToken location, DM_StringToken name);
 bool                  h5_exists_attr(const char* filename, DM_StringToken location, DM_StringToken name);
 
 bool                  h5_create_dataset_from_image(const char* filename, DM_StringToken location, DM_ImageToken image_token);
 bool                  h5_create_dataset_simple(const char* filename, DM_StringToken location, long datatype, DM_TagGroupToken size_token);
+bool                  h5_create_dataset_from_image_opt(const char* filename, DM_StringToken location, DM_ImageToken image_token, DM_TagGroupToken options_token);
+bool                  h5_create_dataset_simple_opt(const char* filename, DM_StringToken location, long datatype, DM_TagGroupToken size_token, DM_TagGroupToken options_token);
+bool                  h5_create_appendable_dataset(const char* filename, DM_StringToken location, long datatype, DM_TagGroupToken frame_size_token);
+bool                  h5_create_appendable_dataset_opt(const char* filename, DM_StringToken location, long datatype, DM_TagGroupToken frame_size_token, DM_TagGroupToken options_token);
+bool                  h5_append(const char* filename, DM_StringToken location, DM_ImageToken image_token);
 DM_ImageToken_1Ref    h5_read_dataset_all(const char* filename, DM_StringToken location);
+DM_ImageToken_1Ref    h5_read_dataset_slice(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_TagGroupToken dims_token, DM_TagGroupToken counts_token, DM_TagGroupToken strides_token);
+DM_ImageToken_1Ref    h5_read_dataset_slice_blocks(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_TagGroupToken dims_token, DM_TagGroupToken counts_token, DM_TagGroupToken strides_token, DM_TagGroupToken blocks_token);
+DM_ImageToken_1Ref    h5_read_dataset_points(const char* filename, DM_StringToken location, DM_ImageToken coords_token);
+DM_ImageToken_1Ref    h5_read_dataset_points_list(const char* filename, DM_StringToken location, DM_TagGroupToken coords_token);
+DM_ImageToken_1Ref    h5_reduce(const char* filename, DM_StringToken location, DM_ImageToken masks_token, DM_TagGroupToken scan_token, DM_TagGroupToken detector_token);
+DM_ImageToken_1Ref    h5_read_dataset_binned(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_TagGroupToken dims_token, DM_TagGroupToken counts_token, DM_TagGroupToken bins_token, const char* mode);
+bool                  h5_read_dataset_into(const char* filename, DM_StringToken location, DM_ImageToken image_token);
+bool                  h5_read_dataset_into_offset(const char* filename, DM_StringToken location, DM_ImageToken image_token, DM_TagGroupToken dest_offset_token);
+bool                  h5_read_dataset_slice_into(const char* filename, DM_StringToken location, DM_ImageToken image_token, DM_TagGroupToken dest_offset_token, DM_TagGroupToken offset_token, DM_TagGroupToken dims_token, DM_TagGroupToken counts_token, DM_TagGroupToken strides_token);
 DM_ImageToken_1Ref    h5_read_dataset_slice1(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, long dim0, long count0, long stride0);
 DM_ImageToken_1Ref    h5_read_dataset_slice2(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, long dim0, long count0, long stride0, long dim1, long count1, long stride1);
 DM_ImageToken_1Ref    h5_read_dataset_slice3(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, long dim0, long count0, long stride0, long dim1, long count1, long stride1, long dim2, long count2, long stride2);
+bool                  h5_write_dataset_slice(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_ImageToken image_token);
+bool                  h5_write_dataset_slice1(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_ImageToken image_token, long dim0, long stride0);
+bool                  h5_write_dataset_slice2(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_ImageToken image_token, long dim0, long stride0, long dim1, long stride1);
+bool                  h5_write_dataset_slice3(const char* filename, DM_StringToken location, DM_TagGroupToken offset_token, DM_ImageToken image_token, long dim0, long stride0, long dim1, long stride1, long dim2, long stride2);
 DM_StringToken_1Ref   h5_read_string_dataset(const char* filename, DM_StringToken location);
+void                  h5_set_direct_read(bool enable);
+
+bool                  h5_open(const char* filename, bool writable);
+bool                  h5_open_readonly(const char* filename);
+bool                  h5_close(const char* filename);
+void                  h5_close_all();
+bool                  h5_flush(const char* filename);
+void                  h5_set_file_cache_size(long size);
+DM_TagGroupToken_1Ref h5_file_cache_stats();
+bool                  h5_set_cache_config(DM_TagGroupToken config_token);
+DM_TagGroupToken_1Ref h5_get_cache_config();
+void                  h5_set_num_threads(long num);
+void                  h5_set_readahead(long frames);
+void                  h5_set_async_write(bool enable);
+bool                  h5_set_info_index(const char* directory);
+bool                  h5_wait();
+long                  h5_pending();
+
+//----------------------------------------------------------------------------------------
+// File cache and access properties (h5_file.cpp)
+
+/**
+ * Opens file through the file cache. Recently used files are kept open,
+ * so repeated calls do not need to reopen the file.
+ * @param filename Name of file.
+ * @param flags H5F_ACC_RDONLY or H5F_ACC_RDWR.
+ * @returns Handle to file, invalid on failure.
+ */
+file_handle_t open_file(const char* filename, unsigned flags);
+
+/** 
+ * Open file for writing, if fails, create it.
+ */
+file_handle_t open_always(const char* filename);
+
+/**
+ * Opens dataset with the chunk cache configured by h5_set_cache_config().
+ * @param loc_id File or group.
+ * @param name Name of dataset relative to @p loc_id.
+ * @returns Handle to dataset, invalid on failure.
+ */
+dataset_handle_t open_dataset(hid_t loc_id, const char* name);
+
+/**
+ * Opens dataset of a file returned by open_file(). The dataset is kept open as long
+ * as the file is cached, so repeated accesses don't need to read its metadata again.
+ * @param file_id File.
+ * @param name Name of dataset relative to the root group.
+ * @returns Handle to dataset, invalid on failure.
+ */
+dataset_handle_t open_cached_dataset(hid_t file_id, const char* name);
+
+/**
+ * Closes datasets kept open by open_cached_dataset(). Must be called when objects
+ * of the file are deleted.
+ */
+void forget_cached_datasets(hid_t file_id);
+
+/**
+ * Flushes file after it was written to, unless it was explicitly opened by h5_open().
+ * @param file_id File to flush.
+ */
+void flush_file(hid_t file_id);
+
+/**
+ * Flushes file after a frame was appended to it. Files kept open by the file cache
+ * are only flushed every few frames, the rest when they are closed or by h5_flush().
+ * @param file_id File to flush.
+ */
+void flush_file_after_append(hid_t file_id);
+
+/** Close all cached files. */
+void close_file_cache();
+
+/** Returns absolute file name, which identifies the file in the cache. */
+std::string normalize_path(const char* filename);
+
+//----------------------------------------------------------------------------------------
+// Datasets (h5_data.cpp)
+
+/** Returns number of datasets read directly from the file, bypassing HDF5. */
+unsigned long get_direct_read_count();
+
+//----------------------------------------------------------------------------------------
+// Parallel chunk I/O (chunk_io.cpp)
+
+class worker_pool_t;
+
+/**
+ * Writes whole dataset, compressing the chunks in parallel and writing them
+ * directly into the file. Only applicable for chunked, deflate compressed datasets,
+ * which need no type conversion.
+ * @param dset_id Dataset to write, must be newly created.
+ * @param memtype_id Type of @p buffer.
+ * @param buffer Data for the whole dataset.
+ * @returns Whether data was written, if not H5Dwrite must be used.
+ */
+bool write_chunks_parallel(hid_t dset_id, hid_t memtype_id, const void* buffer);
+
+/**
+ * Returns worker threads shared by all parallel operations, with the number of threads set
+ * by h5_set_num_threads(). Must be called with the library lock held.
+ */
+worker_pool_t& get_worker_pool();
+
+/** Stops the worker threads. No parallel operation may be running. */
+void stop_worker_pool();
+
+/**
+ * Reads a hyperslab of a dataset, decompressing the chunks in parallel.
+ * Only applicable for chunked, deflate compressed datasets, which need no
+ * type conversion. With the decoded chunk cache enabled, also applicable for 
+ * uncompressed chunked datasets.
+ * @param dset_id Dataset to read.
+ * @param memtype_id Type of @p buffer.
+ * @param offset, stride, count Hyperslab in HDF5 order (like H5Sselect_hyperslab()), all
+ *        NULL for the whole dataset.
+ * @param buffer Receives the selected elements in HDF5 (row-major) order.
+ * @param cached Whether the decoded chunk cache is used. Streaming reads, which
+ *        visit each chunk only once, pass false to keep the cache for slices.
+ * @returns Whether data was read, if not H5Dread must be used.
+ */
+bool read_chunks_parallel(hid_t dset_id, hid_t memtype_id, const hsize_t* offset, const hsize_t* stride, const hsize_t* count, void* buffer,
+                          bool cached = true);
+
+/**
+ * Decompresses the chunks of the hyperslabs following the given one into the decoded
+ * chunk cache on a background thread. Replaces previous readahead.
+ * @param dset_id Dataset opened from @p filename.
+ * @param location Name of dataset.
+ * @param offset, stride, count Hyperslab just read (HDF5 order).
+ * @param step Distance of the following hyperslabs (HDF5 order).
+ */
+void readahead_chunks(hid_t dset_id, const char* filename, const std::string& location, 
+                      const hsize_t* offset, const hsize_t* stride, const hsize_t* count, const hsize_t* step);
+
+/** 
+ * Aborts readahead and waits until the readahead thread has released the library.
+ * Must not be called with the library lock held.
+ */
+void cancel_readahead();
+
+/**
+ * Waits until queued readahead is finished.
+ * Must not be called with the library lock held.
+ */
+void wait_readahead();
+
+/** Adds statistics of readahead to @p tags. */
+void readahead_stats(Gatan::DM::TagGroup& tags);
+
+/** Aborts readahead and stops readahead thread. */
+void stop_readahead();
+
+//----------------------------------------------------------------------------------------
+// Decoded chunk cache (chunk_cache.cpp)
+
+// Identifies the contents of a file, changes when another program writes it
+struct file_stamp_t
+{
+    unsigned long long size;
+    unsigned long long mtime;
+
+    bool operator!=(const file_stamp_t& other) const
+    {
+        return size != other.size || mtime != other.mtime;
+    }
+};
+
+/** Gets size and time of last write of file. */
+bool get_file_stamp(const std::string& path, file_stamp_t& stamp);
+
+/**
+ * Returns key of dataset for the decoded chunk cache. Drops cached chunks of the
+ * file, if it was changed since they were read.
+ * @returns Key, empty if cache is disabled or the dataset can't be identified.
+ */
+std::string decoded_cache_key(hid_t dset_id);
+
+/**
+ * Looks up decompressed chunk.
+ * @param key Key returned by decoded_cache_key().
+ * @param offset Element offset of chunk.
+ * @param data OUT: Copy of chunk.
+ * @returns Whether chunk was found.
+ */
+bool decoded_cache_find(const std::string& key, const std::vector<hsize_t>& offset, std::vector<char>& data);
+
+/**
+ * Inserts decompressed chunk, evicting least recently used chunks.
+ * @param data Chunk, moved into the cache (empty on return).
+ */
+void decoded_cache_insert(const std::string& key, const std::vector<hsize_t>& offset, std::vector<char>& data);
+
+/** Returns whether chunk is cached, without counting a hit or miss. */
+bool decoded_cache_contains(const std::string& key, const std::vector<hsize_t>& offset);
+
+/**
+ * Returns counter, which changes whenever cached chunks are dropped. Chunks read before
+ * a change must not be inserted.
+ */
+unsigned long decoded_cache_generation();
+
+/**
+ * Drops cached chunks of a file. Must be called before writing to the file.
+ * @param path Normalized file name.
+ */
+void invalidate_decoded_cache(const std::string& path);
+
+/** Returns and sets maximum size of the decoded chunk cache in bytes, 0 disables the cache. */
+std::size_t get_decoded_cache_size();
+void set_decoded_cache_size(std::size_t size);
+
+/** Adds statistics of the decoded chunk cache to @p tags. */
+void decoded_cache_stats(Gatan::DM::TagGroup& tags);
+
+//----------------------------------------------------------------------------------------
+// Metadata index (info_index.cpp)
+
+/**
+ * Reads index of a file written by store_info_index().
+ * @param path Normalized file name.
+ * @param data OUT: Contents of the index.
+ * @returns Whether an index matching the current size and time of the file exists.
+ */
+bool load_info_index(const std::string& path, std::vector<char>& data);
+
+/** Writes index of a file, if indices are enabled by h5_set_info_index(). */
+void store_info_index(const std::string& path, const std::vector<char>& data);
+
+/** Deletes index of a file. Must be called before writing to the file. */
+void invalidate_info_index(const std::string& path);
+
+//----------------------------------------------------------------------------------------
+// Binning (binning.cpp)
+
+/** Accumulators of bins, the member used depends on the input type. */
+struct binning_acc_t
+{
+    std::vector<long long>          i;  // Signed integers
+    std::vector<unsigned long long> u;  // Unsigned integers
+    std::vector<double>             d;  // Floating point
+};
+
+/** Sets @p size zeroed accumulators for input type @p dtype. */
+void reset_binning_acc(long dtype, std::size_t size, binning_acc_t& acc);
+
+/**
+ * Returns type of binned image for input type @p dtype, -1 if unsupported. Sums of 
+ * small integers are 32 bit integers, of larger integers double.
+ * @param mean Whether the mean of the bins is returned instead of the sum.
+ */
+long binned_datatype(long dtype, bool mean);
+
+/**
+ * Adds bins of elements to accumulators.
+ * @param dtype Type of @p input.
+ * @param input Elements with extent @p in_dims.
+ * @param in_dims, bins Extent and size of bins (HDF5 order, 4 dimensions). Extents must
+ *        be multiples of the bin sizes.
+ * @param acc IN/OUT: Accumulators with extent in_dims / bins, see reset_binning_acc().
+ * @returns Whether type is supported.
+ */
+bool bin_elements(long dtype, const void* input, const hsize_t* in_dims, const hsize_t* bins, binning_acc_t& acc);
+
+/**
+ * Converts accumulators to elements of binned image.
+ * @param dtype Type of input passed to bin_elements().
+ * @param divisor Elements per bin for mean, 0 for sum.
+ * @param out_dtype Type of @p output, see binned_datatype().
+ * @returns Whether types are supported.
+ */
+bool store_binned(long dtype, const binning_acc_t& acc, double divisor, long out_dtype, void* output);
+
+//----------------------------------------------------------------------------------------
+// Asynchronous writes (write_queue.cpp)
+
+/**
+ * A write executed by the write thread. Holds a copy of the data to write.
+ */
+struct write_job_t
+{
+    std::string filename;       // As passed by the script
+    std::string path;           // Normalized file name
+    std::string location;
+    std::size_t size;           // Bytes of data held by job
+
+    write_job_t(const char* filename, const std::string& location);
+    virtual ~write_job_t() {}
+
+    /**
+     * Writes data. Called with the library lock held.
+     * @returns Whether succeeded.
+     */
+    virtual bool run() = 0;
+};
+
+/**
+ * Serializes calls of the HDF5 library, which is not thread safe, between the
+ * script thread and the write thread. Every script function calling the library
+ * holds it. Reports warnings of the write thread, e.g. failed writes.
+ */
+class library_lock_t
+{
+private:
+    // No copy
+    library_lock_t(const library_lock_t&);
+    library_lock_t& operator=(const library_lock_t&);
+
+public:
+    /**
+     * Locks library.
+     * @param filename If not NULL, waits until queued writes to this file are finished before.
+     */
+    explicit library_lock_t(const char* filename = NULL);
+    ~library_lock_t();
+};
+
+/** Returns whether writes are queued, see h5_set_async_write(). */
+bool async_writes_enabled();
+
+/**
+ * Queues job for the write thread. Waits, if too much data is queued.
+ * Must not be called with the library lock held.
+ * @param job Job, deleted after executed.
+ */
+void queue_write(write_job_t* job);
+
+/**
+ * Defers message, if called by a background thread. It is reported on the script thread later.
+ * @returns Whether message was deferred.
+ */
+bool defer_message(const char* message);
+
+/**
+ * Registers (or unregisters) the calling thread as background thread, whose messages are
+ * deferred. Background threads must not call DM.
+ */
+void register_background_thread(bool enable);
+
+/** Waits until all queued writes are finished. */
+void wait_write_queue();
+
+/** Finishes queued writes and stops write thread. */
+void stop_write_queue();
 
 //----------------------------------------------------------------------------------------
 // Utility functions (utils.cpp)
@@ -72,6 +455,9 @@ void warning(const char* fmt, ...);
 /** Debug dump HDF error stack. */
 void dump_HDF_error_stack();
 
+/** Frees memory allocated by the HDF5 library, which may use another C runtime than the plugin. */
+void free_HDF(void* ptr);
+
 /** Convert UTF8 string to DM string. */
 Gatan::DM::String from_UTF8(const std::string &input);
 
@@ -142,7 +528,7 @@ Gatan::DM::Image create_image(long datatype, int rank, const hsize_t* dims);
  * @param dims OUT: Extents of the individual dimensions
  * @return Number of dimensions (rank), <0 on failure
  */
-int hsize_array_from_HDF5(int space_id, std::vector<hsize_t>& dims);
+int hsize_array_from_HDF5(hid_t space_id, std::vector<hsize_t>& dims);
 
 /** 
  * Convert hsize_t[] array to DM tag list. Reverses order of entries, since
@@ -161,11 +547,6 @@ Gatan::DM::TagGroup taglist_from_hsize_array(const hsize_t* ptr, int size);
  */
 std::vector<hsize_t> hsize_array_from_taglist(const Gatan::DM::TagGroup& list);
 
-/** 
- * Open file for writing, if fails, create it.
- */
-file_handle_t open_always(const char* filename);
-
 #ifndef ENABLE_DEBUG
 
 inline void debug(const char* fmt, ...)
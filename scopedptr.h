@@ -32,7 +32,7 @@ public:
         T* tmp = ptr;
         if (tmp) {
             ptr = NULL;
-            dealloc(ptr); 
+            dealloc(tmp); 
         }
     }
 
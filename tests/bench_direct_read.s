@@ -0,0 +1,53 @@
+// Benchmark of h5_read_dataset for a large contiguous dataset,
+// with and without reading directly from the file.
+//
+// NOTE
+//  * _tmp_dir must contain to a tmp directory (user must have write permission)
+//    with enough space for the test file (see size_z below).
+//  * The OS file cache is not flushed between reads. For disk bandwidth
+//    measurements use a file larger than the main memory.
+
+{
+    number size_x = 2048, size_y = 2048, size_z = 256     // 2 GB of UInt16
+    number repeats = 3
+
+    // Contrary to the documentation 6 (instead of 3) gives temporary directory
+    string tmp_dir = GetApplicationDirectory(6, 1)
+    string tmp_file = PathConcatenate(tmp_dir, "bench_" + Hex(GetHighResTickCount(), 16) + ".hdf5")
+
+    Image data := IntegerImage("bench", 2, 0, size_x, size_y, size_z)
+    data = icol + irow + iplane
+    if (!h5_create_dataset(tmp_file, "data", data))
+        Throw("Creating test file failed.")
+    data := Null
+    h5_close(tmp_file)
+
+    number mbytes = size_x * size_y * size_z * 2 / (1024 * 1024)
+    number direct
+    for (direct = 0; direct <= 1; direct++) {
+        h5_set_direct_read(direct)
+
+        number direct_reads
+        h5_file_cache_stats().TagGroupGetTagAsNumber("DirectReads", direct_reads)
+
+        number n
+        for (n = 0; n < repeats; n++) {
+            number start = GetHighResTickCount()
+            Image load := h5_read_dataset(tmp_file, "data")
+            number seconds = CalcHighResSecondsBetween(start, GetHighResTickCount())
+            load := Null
+
+            Result("direct=" + direct + " run " + n + ": " + Format(seconds, "%.3f") + " s, " + Format(mbytes / seconds, "%.1f") + " MB/s\n")
+        }
+
+        // Make sure the direct path was actually taken (or not)
+        number new_direct_reads
+        h5_file_cache_stats().TagGroupGetTagAsNumber("DirectReads", new_direct_reads)
+        if (new_direct_reads - direct_reads != direct * repeats)
+            Throw("direct=" + direct + ": " + (new_direct_reads - direct_reads) + " direct reads, expected " + direct * repeats + ".")
+    }
+
+    h5_set_direct_read(1)
+    h5_close(tmp_file)
+    DeleteFile(tmp_file)
+}
@@ -0,0 +1,34 @@
+// Benchmark of h5_info for a file with many datasets.
+//
+// NOTE
+//  * _tmp_dir must contain to a tmp directory (user must have write permission).
+
+{
+    number num_datasets = 20000
+    number repeats = 3
+
+    // Contrary to the documentation 6 (instead of 3) gives temporary directory
+    string tmp_dir = GetApplicationDirectory(6, 1)
+    string tmp_file = PathConcatenate(tmp_dir, "bench_" + Hex(GetHighResTickCount(), 16) + ".hdf5")
+
+    Image data := RealImage("bench", 4, 4, 4)
+    number d
+    for (d = 0; d < num_datasets; d++)
+        if (!h5_create_dataset(tmp_file, "d" + Format(d, "%05d"), data))
+            Throw("Creating test file failed.")
+    h5_close(tmp_file)
+
+    number n
+    for (n = 0; n < repeats; n++) {
+        number start = GetHighResTickCount()
+        TagGroup info = h5_info(tmp_file)
+        number seconds = CalcHighResSecondsBetween(start, GetHighResTickCount())
+
+        TagGroup contents
+        info.TagGroupGetTagAsTagGroup("Contents", contents)
+        Result("run " + n + ": " + Format(seconds, "%.3f") + " s, " + contents.TagGroupCountTags() + " objects\n")
+    }
+
+    h5_close(tmp_file)
+    DeleteFile(tmp_file)
+}
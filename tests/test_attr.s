@@ -145,6 +145,99 @@ class Test_H5_Attr: TestCase
         self.assert_false("attr", h5_exists_attr(_file_path, "noent", "_bla_bla_foo"))
     }
 
+    void test_array_image(Object self)
+    {
+        image img := h5_read_attr_array(_file_path, "/data", "array")
+        self.assert_valid("img", img)
+        self.assert_eq("img.ndim", ImageGetNumDimensions(img), 2)
+        self.assert_eq("img.dim[0]", ImageGetDimensionSize(img, 0), 10)
+        self.assert_eq("img.dim[1]", ImageGetDimensionSize(img, 1), 10)
+        self.assert_eq("img[3, 2]", img.GetPixel(3, 2), 23)
+        self.assert_eq("sum(img)", sum(img), 4950)
+
+        image cube := h5_read_attr_array(_file_path, "/data", "threeDim")
+        self.assert_valid("cube", cube)
+        self.assert_eq("cube.ndim", ImageGetNumDimensions(cube), 3)
+        self.assert_eq("sum(cube)", sum(cube), 7750)
+
+        image clist := h5_read_attr_array(_file_path, "/data", "clist")
+        self.assert_valid("clist", clist)
+        self.assert_true("clist complex", ImageIsDataTypeComplex(clist))
+        self.assert_eq("clist.dim[0]", ImageGetDimensionSize(clist, 0), 5)
+
+        image strings := h5_read_attr_array(_file_path, "/data", "StrList")
+        self.assert_not_valid("strings", strings)
+        image noent := h5_read_attr_array(_file_path, "/data", "_bla_bla_foo")
+        self.assert_not_valid("noent", noent)
+    }
+
+    void test_image_threshold(Object self)
+    {
+        taggroup attr = h5_read_attr(_file_path, "/data", 4)
+        self.assert_valid("attr", attr)
+
+        // Below the threshold, not numeric, or more than one dimension: tag lists as before
+        self.assert_tag_count("attr", attr, "list", 3)
+        self.assert_tag_count("attr", attr, "StrList", 3)
+        self.assert_tag_count("attr", attr, "array", 10)
+        self.assert_tag_eq("attr", attr, "int", 5)
+
+        // Array tags are copied into an image of the same size and type
+        image clist := ComplexImage("clist", 16, 5)
+        clist = 0
+        self.assert_true("clist", TagGroupGetTagAsArray(attr, "clist", clist))
+        image expected := h5_read_attr_array(_file_path, "/data", "clist")
+        self.assert_eq("sum(abs(clist - expected))", sum(abs(clist - expected)), 0)
+    }
+
+    void test_selected_attr(Object self)
+    {
+        taggroup names = NewTagList()
+        names.TagGroupInsertTagAsString(infinity(), "int")
+        names.TagGroupInsertTagAsString(infinity(), "_bla_bla_foo")
+        names.TagGroupInsertTagAsString(infinity(), "list")
+
+        taggroup attr = h5_read_attr(_file_path, "/data", names)
+        self.assert_valid("attr", attr)
+        self.assert_eq("len(attr)", 2, TagGroupCountTags(attr))
+        self.assert_tag_eq("attr", attr, "int", 5)
+        self.assert_tag_count("attr", attr, "list", 3)
+
+        taggroup none = h5_read_attr(_file_path, "/data", NewTagList())
+        self.assert_eq("len(none)", 0, TagGroupCountTags(none))
+
+        taggroup numbers = NewTagList()
+        numbers.TagGroupInsertTagAsLong(infinity(), 1)
+        self.assert_false("numbers", TagGroupIsValid(h5_read_attr(_file_path, "/data", numbers)))
+        self.assert_false("noent", TagGroupIsValid(h5_read_attr(_file_path, "/noent", names)))
+    }
+
+    void test_attr_tree(Object self)
+    {
+        taggroup tree = h5_read_attr_tree(_file_path, "/", -1)
+        self.assert_valid("tree", tree)
+
+        // Objects without attributes are not listed
+        self.assert_eq("len(tree)", 1, TagGroupCountTags(tree))
+        taggroup entry, attr
+        self.assert_true("entry", tree.TagGroupGetIndexedTagAsTagGroup(0, entry))
+        self.assert_tag_eq("entry", entry, "Path", "/data")
+        self.assert_true("Attributes", entry.TagGroupGetTagAsTagGroup("Attributes", attr))
+        self.assert_tag_eq("attr", attr, "int", 5)
+        self.assert_tag_count("attr", attr, "list", 3)
+
+        taggroup data = h5_read_attr_tree(_file_path, "data", 0)
+        self.assert_eq("len(data)", 1, TagGroupCountTags(data))
+        self.assert_true("entry", data.TagGroupGetIndexedTagAsTagGroup(0, entry))
+        self.assert_tag_eq("entry", entry, "Path", "/data")
+        self.assert_tag_eq("entry", entry, "Attributes:float", 6.0)
+
+        taggroup top = h5_read_attr_tree(_file_path, "/", 0)
+        self.assert_eq("len(top)", 0, TagGroupCountTags(top))
+
+        self.assert_false("noent", TagGroupIsValid(h5_read_attr_tree(_file_path, "/noent", -1)))
+    }
+
     Test_H5_Attr(Object self)
     {
         self.register_test("test_not_a_file")
@@ -158,6 +251,10 @@ class Test_H5_Attr: TestCase
         self.register_test("test_integer_array_3d")
         self.register_test("test_unicode")
         self.register_test("test_existance")
+        self.register_test("test_array_image")
+        self.register_test("test_image_threshold")
+        self.register_test("test_selected_attr")
+        self.register_test("test_attr_tree")
     }
 }
 
@@ -188,6 +188,465 @@ class Test_H5_DataSet: TestCase
         self.assert_eq("sum(load - data2)", 0, sum(load - data2))
     }
     
+    void test_direct_read(Object self)
+    {
+        Image data := IntegerImage("foo", 2, 0, 100, 50, 4)
+        self.randomize_image(data, 0, 65535)
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data))
+
+        h5_set_direct_read(0)
+        Image load1 := h5_read_dataset(_tmp_file, "data")
+        h5_set_direct_read(1)
+        Image load2 := h5_read_dataset(_tmp_file, "data")
+
+        self.assert_valid("load1", load1)
+        self.assert_valid("load2", load2)
+        self.assert_eq("sum(load1 - data)", 0, sum(load1 - data))
+        self.assert_eq("sum(load2 - data)", 0, sum(load2 - data))
+    }
+    
+    void test_create_options(Object self)
+    {
+        Image data := IntegerImage("foo", 2, 0, 64, 32, 8)
+        data = icol + irow
+        
+        TagGroup chunk = NewTagList()
+        chunk.TagGroupInsertTagAsLong(infinity(), 64)
+        chunk.TagGroupInsertTagAsLong(infinity(), 32)
+        chunk.TagGroupInsertTagAsLong(infinity(), 1)
+
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsTagGroup("ChunkSize", chunk)
+        options.TagGroupSetTagAsLong("Deflate", 4)
+        options.TagGroupSetTagAsBoolean("Shuffle", 1)
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data, options))
+
+        self.assert_false("options unchanged", options.TagGroupDoesTagExist("StorageSize"))
+
+        TagGroup storage_options = NewTagGroup()
+        storage_options.TagGroupSetTagAsBoolean("Storage", 1)
+        TagGroup info = h5_info(_tmp_file, "data", storage_options)
+        number storage_size
+        self.assert_true("StorageSize", info.TagGroupGetTagAsNumber("StorageSize", storage_size))
+        self.assert_gt("storage_size", storage_size, 0)
+        self.assert_lt("storage_size", storage_size, 64 * 32 * 8 * 2)
+        self.assert_tag_eq("info", info, "ChunkSize[0]", 64)
+        self.assert_tag_eq("info", info, "ChunkSize[2]", 1)
+
+        Image load := h5_read_dataset(_tmp_file, "data")
+        self.assert_valid("load", load)
+        self.assert_eq("sum(load - data)", 0, sum(load - data))
+    }
+
+    void test_chunk_bytes(Object self)
+    {
+        // 7 empty frames and 3 frames of noise, which compress badly
+        Image data := IntegerImage("foo", 4, 0, 64, 32, 10)
+        data = (iplane >= 7) * floor(random() * 1e6)
+
+        TagGroup chunk = NewTagList()
+        chunk.TagGroupInsertTagAsLong(infinity(), 64)
+        chunk.TagGroupInsertTagAsLong(infinity(), 32)
+        chunk.TagGroupInsertTagAsLong(infinity(), 1)
+
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsTagGroup("ChunkSize", chunk)
+        options.TagGroupSetTagAsLong("Deflate", 4)
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data, options))
+
+        options = NewTagGroup()
+        options.TagGroupSetTagAsBoolean("Storage", 1)
+        TagGroup info = h5_info(_tmp_file, "data", options)
+        self.assert_tag_eq("info", info, "NumChunks", 10)
+
+        TagGroup chunk_bytes
+        self.assert_true("ChunkBytes", info.TagGroupGetTagAsTagGroup("ChunkBytes", chunk_bytes))
+        number min_bytes, max_bytes, median, p90
+        chunk_bytes.TagGroupGetTagAsNumber("Min", min_bytes)
+        chunk_bytes.TagGroupGetTagAsNumber("Max", max_bytes)
+        chunk_bytes.TagGroupGetTagAsNumber("Median", median)
+        chunk_bytes.TagGroupGetTagAsNumber("P90", p90)
+        self.assert_tag_eq("ChunkBytes", chunk_bytes, "P10", min_bytes)
+        self.assert_eq("Median", min_bytes, median)
+        self.assert_gt("P90", p90, median)
+        self.assert_true("P90 <= Max", p90 <= max_bytes)
+    }
+
+    void test_create_parallel(Object self)
+    {
+        Image data := RealImage("foo", 4, 100, 70, 9)
+        data = icol * 0.5 + irow - iplane
+        
+        TagGroup chunk = NewTagList()
+        chunk.TagGroupInsertTagAsLong(infinity(), 32)
+        chunk.TagGroupInsertTagAsLong(infinity(), 32)
+        chunk.TagGroupInsertTagAsLong(infinity(), 2)
+
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsTagGroup("ChunkSize", chunk)
+        options.TagGroupSetTagAsLong("Deflate", 6)
+        options.TagGroupSetTagAsBoolean("Shuffle", 1)
+
+        h5_set_num_threads(4)
+        self.assert_true("create parallel", h5_create_dataset(_tmp_file, "parallel", data, options))
+        h5_set_num_threads(1)
+        self.assert_true("create serial", h5_create_dataset(_tmp_file, "serial", data, options))
+        h5_set_num_threads(0)
+
+        Image parallel := h5_read_dataset(_tmp_file, "parallel")
+        Image serial := h5_read_dataset(_tmp_file, "serial")
+        self.assert_valid("parallel", parallel)
+        self.assert_valid("serial", serial)
+        self.assert_eq("sum(parallel - data)", 0, sum(abs(parallel - data)))
+        self.assert_eq("sum(parallel - serial)", 0, sum(abs(parallel - serial)))
+    }
+
+    void test_read_parallel(Object self)
+    {
+        Image data := IntegerImage("foo", 2, 1, 90, 80, 7)
+        data = icol + 2 * irow + 3 * iplane
+        
+        TagGroup chunk = NewTagList()
+        chunk.TagGroupInsertTagAsLong(infinity(), 20)
+        chunk.TagGroupInsertTagAsLong(infinity(), 30)
+        chunk.TagGroupInsertTagAsLong(infinity(), 2)
+
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsTagGroup("ChunkSize", chunk)
+        options.TagGroupSetTagAsLong("Deflate", 4)
+        options.TagGroupSetTagAsBoolean("Shuffle", 1)
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data, options))
+
+        TagGroup offset = NewTagList()
+        offset.TagGroupInsertTagAsLong(infinity(), 5)
+        offset.TagGroupInsertTagAsLong(infinity(), 3)
+        offset.TagGroupInsertTagAsLong(infinity(), 1)
+
+        h5_set_num_threads(4)
+        Image parallel := h5_read_dataset(_tmp_file, "data")
+        Image parallel_slice := h5_read_dataset_slice2(_tmp_file, "data", offset, 0, 20, 4, 2, 3, 2)
+        h5_set_num_threads(1)
+        Image serial_slice := h5_read_dataset_slice2(_tmp_file, "data", offset, 0, 20, 4, 2, 3, 2)
+        h5_set_num_threads(0)
+
+        self.assert_valid("parallel", parallel)
+        self.assert_valid("parallel_slice", parallel_slice)
+        self.assert_valid("serial_slice", serial_slice)
+        self.assert_eq("sum(parallel - data)", 0, sum(abs(parallel - data)))
+        self.assert_eq("sum(parallel_slice - serial_slice)", 0, sum(abs(parallel_slice - serial_slice)))
+        self.assert_eq("parallel_slice[1, 2]", 5 + 4 + 2 * 3 + 3 * 5, parallel_slice.GetPixel(1, 2))
+    }
+
+    void test_read_into(Object self)
+    {
+        Image data := IntegerImage("foo", 2, 1, 90, 80, 7)
+        data = icol + 2 * irow + 3 * iplane
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data))
+
+        Image all := IntegerImage("all", 2, 1, 90, 80, 7)
+        self.assert_true("read all", h5_read_dataset_into(_tmp_file, "data", all))
+        self.assert_eq("sum(all - data)", 0, sum(abs(all - data)))
+
+        // Gather frames in reverse order into a stack
+        Image stack := IntegerImage("stack", 2, 1, 90, 80, 3)
+        TagGroup dims = NewTagList()
+        dims.TagGroupInsertTagAsLong(infinity(), 0)
+        dims.TagGroupInsertTagAsLong(infinity(), 1)
+        TagGroup counts = NewTagList()
+        counts.TagGroupInsertTagAsLong(infinity(), 90)
+        counts.TagGroupInsertTagAsLong(infinity(), 80)
+        TagGroup strides = NewTagList()
+        strides.TagGroupInsertTagAsLong(infinity(), 1)
+        strides.TagGroupInsertTagAsLong(infinity(), 1)
+        for (number z = 0; z < 3; z++) {
+            TagGroup offset = NewTagList()
+            offset.TagGroupInsertTagAsLong(infinity(), 0)
+            offset.TagGroupInsertTagAsLong(infinity(), 0)
+            offset.TagGroupInsertTagAsLong(infinity(), z)
+            TagGroup dest_offset = NewTagList()
+            dest_offset.TagGroupInsertTagAsLong(infinity(), 0)
+            dest_offset.TagGroupInsertTagAsLong(infinity(), 0)
+            dest_offset.TagGroupInsertTagAsLong(infinity(), 2 - z)
+            self.assert_true("read frame", h5_read_dataset_into(_tmp_file, "data", stack, dest_offset, offset, dims, counts, strides))
+        }
+        self.assert_eq("stack[0]", 0, sum(abs(stack.slice2(0, 0, 0, 0, 90, 1, 1, 80, 1) - data.slice2(0, 0, 2, 0, 90, 1, 1, 80, 1))))
+        self.assert_eq("stack[2]", 0, sum(abs(stack.slice2(0, 0, 2, 0, 90, 1, 1, 80, 1) - data.slice2(0, 0, 0, 0, 90, 1, 1, 80, 1))))
+
+        // Type and size of image must fit
+        Image wrong_type := RealImage("wrong", 4, 90, 80, 7)
+        self.assert_false("wrong type", h5_read_dataset_into(_tmp_file, "data", wrong_type))
+        Image too_small := IntegerImage("small", 2, 1, 90, 80, 6)
+        self.assert_false("too small", h5_read_dataset_into(_tmp_file, "data", too_small))
+    }
+
+    void test_read_binned(Object self)
+    {
+        Image data := IntegerImage("foo", 2, 0, 64, 48, 3)
+        data = icol + 64 * irow + iplane
+
+        TagGroup chunk = NewTagList()
+        chunk.TagGroupInsertTagAsLong(infinity(), 32)
+        chunk.TagGroupInsertTagAsLong(infinity(), 16)
+        chunk.TagGroupInsertTagAsLong(infinity(), 1)
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsTagGroup("ChunkSize", chunk)
+        options.TagGroupSetTagAsLong("Deflate", 4)
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data, options))
+
+        TagGroup offset = NewTagList()
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 1)
+        TagGroup dims = NewTagList()
+        dims.TagGroupInsertTagAsLong(infinity(), 0)
+        dims.TagGroupInsertTagAsLong(infinity(), 1)
+        TagGroup counts = NewTagList()
+        counts.TagGroupInsertTagAsLong(infinity(), 16)
+        counts.TagGroupInsertTagAsLong(infinity(), 12)
+        TagGroup bins = NewTagList()
+        bins.TagGroupInsertTagAsLong(infinity(), 4)
+        bins.TagGroupInsertTagAsLong(infinity(), 4)
+
+        // Bins of 4 x 4 pixels of plane 1
+        Image sum := h5_read_dataset_binned(_tmp_file, "data", offset, dims, counts, bins, "Sum")
+        Image mean := h5_read_dataset_binned(_tmp_file, "data", offset, dims, counts, bins, "Mean")
+        self.assert_valid("sum", sum)
+        self.assert_valid("mean", mean)
+        self.assert_eq("sum.dim[0]", 16, ImageGetDimensionSize(sum, 0))
+        self.assert_eq("sum.dim[1]", 12, ImageGetDimensionSize(sum, 1))
+        self.assert_eq("sum[0, 0]", 16 * 1 + 4 * 6 + 64 * 4 * 6, sum.GetPixel(0, 0))
+        self.assert_eq("mean[2, 1]", 1 + 8 + 1.5 + 64 * (4 + 1.5), mean.GetPixel(2, 1))
+        self.assert_eq("sum(sum)", sum(data.slice2(0, 0, 1, 0, 64, 1, 1, 48, 1)), sum(sum))
+
+        Image invalid := h5_read_dataset_binned(_tmp_file, "data", offset, dims, counts, bins, "Max")
+        self.assert_not_valid("invalid mode", invalid)
+    }
+
+    void test_reduce(Object self)
+    {
+        // 4D dataset with frames of 8 x 6 pixels on a scan of 5 x 4 positions
+        Image data := NewImage("foo", 2, 8, 6, 5, 4)
+        number x, y, k
+        for (y = 0; y < 4; y++)
+            for (x = 0; x < 5; x++)
+                data.slice2(0, 0, x, y, 0, 8, 1, 1, 6, 1) = icol + 10 * irow + 100 * x + 1000 * y
+
+        // Chunks of two scan positions, so several tiles with several chunks are read
+        TagGroup chunk = NewTagList()
+        chunk.TagGroupInsertTagAsLong(infinity(), 8)
+        chunk.TagGroupInsertTagAsLong(infinity(), 6)
+        chunk.TagGroupInsertTagAsLong(infinity(), 2)
+        chunk.TagGroupInsertTagAsLong(infinity(), 1)
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsTagGroup("ChunkSize", chunk)
+        options.TagGroupSetTagAsLong("Deflate", 4)
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data, options))
+
+        TagGroup detector = NewTagList()
+        detector.TagGroupInsertTagAsLong(infinity(), 0)
+        detector.TagGroupInsertTagAsLong(infinity(), 1)
+        TagGroup scan = NewTagList()
+        scan.TagGroupInsertTagAsLong(infinity(), 2)
+        scan.TagGroupInsertTagAsLong(infinity(), 3)
+
+        // Sum of all pixels and of the left column
+        Image masks := RealImage("masks", 4, 8, 6, 2)
+        masks = 0
+        masks.slice2(0, 0, 0, 0, 8, 1, 1, 6, 1) = 1
+        masks.slice2(0, 0, 1, 1, 6, 1, 0, 1, 1) = 1
+
+        // Streaming the tiles leaves the decoded chunk cache alone
+        TagGroup stats = h5_file_cache_stats()
+        number cached_chunks
+        stats.TagGroupGetTagAsNumber("DecodedCacheChunks", cached_chunks)
+
+        Image result := h5_reduce(_tmp_file, "data", masks, scan, detector)
+        self.assert_valid("result", result)
+        self.assert_eq("result.ndim", 3, ImageGetNumDimensions(result))
+        self.assert_eq("result.dim[0]", 5, ImageGetDimensionSize(result, 0))
+        self.assert_eq("result.dim[1]", 4, ImageGetDimensionSize(result, 1))
+        self.assert_eq("result.dim[2]", 2, ImageGetDimensionSize(result, 2))
+        stats = h5_file_cache_stats()
+        self.assert_tag_eq("stats", stats, "DecodedCacheChunks", cached_chunks)
+
+        for (k = 0; k < 2; k++) {
+            Image mask := masks.slice2(0, 0, k, 0, 8, 1, 1, 6, 1)
+            for (y = 0; y < 4; y++) {
+                for (x = 0; x < 5; x++) {
+                    number expected = sum(data.slice2(0, 0, x, y, 0, 8, 1, 1, 6, 1) * mask)
+                    self.assert_eq("result[" + x + ", " + y + ", " + k + "]", expected, sum(result.slice1(x, y, k, 0, 1, 1)))
+                }
+            }
+        }
+
+        // Detector dimensions must be first
+        Image invalid := h5_reduce(_tmp_file, "data", masks, detector, scan)
+        self.assert_not_valid("swapped dimensions", invalid)
+    }
+
+    void test_append(Object self)
+    {
+        TagGroup frame_size = NewTagList()
+        frame_size.TagGroupInsertTagAsLong(infinity(), 16)
+        frame_size.TagGroupInsertTagAsLong(infinity(), 8)
+        self.assert_true("create", h5_create_appendable_dataset(_tmp_file, "frames", 2, frame_size))
+        self.assert_true("open", h5_open(_tmp_file, 1))
+
+        number n
+        for (n = 0; n < 5; n++) {
+            Image frame := RealImage("frame", 4, 16, 8)
+            frame = icol + irow + n * 100
+            self.assert_true("append", h5_append(_tmp_file, "frames", frame))
+        }
+        Image stack := RealImage("stack", 4, 16, 8, 2)
+        stack = icol + irow + (iplane + 5) * 100
+        self.assert_true("append stack", h5_append(_tmp_file, "frames", stack))
+
+        Image wrong := RealImage("wrong", 4, 8, 16)
+        self.assert_false("append wrong size", h5_append(_tmp_file, "frames", wrong))
+        self.assert_true("close", h5_close(_tmp_file))
+
+        Image load := h5_read_dataset(_tmp_file, "frames")
+        self.assert_valid("load", load)
+        number sx, sy, sz
+        load.Get3DSize(sx, sy, sz)
+        self.assert_eq("frames", 7, sz)
+
+        Image expected := RealImage("expected", 4, 16, 8, 7)
+        expected = icol + irow + iplane * 100
+        self.assert_eq("sum(load - expected)", 0, sum(abs(load - expected)))
+    }
+
+    void test_write_slice(Object self)
+    {
+        TagGroup size = NewTagList()
+        size.TagGroupInsertTagAsLong(infinity(), 8)
+        size.TagGroupInsertTagAsLong(infinity(), 6)
+        size.TagGroupInsertTagAsLong(infinity(), 3)
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", 7, size))
+
+        TagGroup offset = NewTagList()
+        offset.TagGroupInsertTagAsLong(infinity(), 4)
+        offset.TagGroupInsertTagAsLong(infinity(), 3)
+        offset.TagGroupInsertTagAsLong(infinity(), 1)
+        Image tile := IntegerImage("tile", 4, 1, 4, 3)
+        tile = 100 + icol + 4 * irow
+        self.assert_true("write tile", h5_write_dataset_slice(_tmp_file, "data", offset, tile))
+
+        offset.TagGroupSetIndexedTagAsLong(0, 1)
+        offset.TagGroupSetIndexedTagAsLong(1, 0)
+        offset.TagGroupSetIndexedTagAsLong(2, 0)
+        Image strided := IntegerImage("strided", 4, 1, 4, 3)
+        strided = 200 + icol + 4 * irow
+        self.assert_true("write strided", h5_write_dataset_slice(_tmp_file, "data", offset, strided, 0, 2, 2, 1))
+
+        offset.TagGroupSetIndexedTagAsLong(0, 5)
+        self.assert_false("write outside", h5_write_dataset_slice(_tmp_file, "data", offset, tile))
+
+        offset.TagGroupSetIndexedTagAsLong(0, 4)
+        offset.TagGroupSetIndexedTagAsLong(1, 3)
+        offset.TagGroupSetIndexedTagAsLong(2, 1)
+        Image load_tile := h5_read_dataset_slice2(_tmp_file, "data", offset, 0, 4, 1, 1, 3, 1)
+        self.assert_valid("load_tile", load_tile)
+        self.assert_eq("tile", 0, sum(abs(load_tile - tile)))
+
+        Image load := h5_read_dataset(_tmp_file, "data")
+        self.assert_valid("load", load)
+        self.assert_eq("strided[0, 0]", 200, sum(load[1, 0, 0, 2, 1, 1]))
+        self.assert_eq("strided[3, 2]", 211, sum(load[7, 0, 2, 8, 1, 3]))
+        self.assert_eq("unwritten", 0, sum(load[0, 0, 0, 1, 1, 1]))
+    }
+
+    void test_async_write(Object self)
+    {
+        TagGroup frame_size = NewTagList()
+        frame_size.TagGroupInsertTagAsLong(infinity(), 16)
+        frame_size.TagGroupInsertTagAsLong(infinity(), 8)
+        self.assert_true("create", h5_create_appendable_dataset(_tmp_file, "frames", 2, frame_size))
+
+        h5_set_async_write(1)
+        number n
+        for (n = 0; n < 5; n++) {
+            Image frame := RealImage("frame", 4, 16, 8)
+            frame = icol + irow + n * 100
+            self.assert_true("append", h5_append(_tmp_file, "frames", frame))
+        }
+        Image image := RealImage("image", 4, 10, 20)
+        image = icol * irow
+        self.assert_true("create from image", h5_create_dataset(_tmp_file, "image", image))
+        self.assert_true("wait", h5_wait())
+        self.assert_eq("pending", 0, h5_pending())
+        h5_set_async_write(0)
+
+        Image load := h5_read_dataset(_tmp_file, "frames")
+        self.assert_valid("load", load)
+        Image expected := RealImage("expected", 4, 16, 8, 5)
+        expected = icol + irow + iplane * 100
+        self.assert_eq("sum(load - expected)", 0, sum(abs(load - expected)))
+
+        Image load_image := h5_read_dataset(_tmp_file, "image")
+        self.assert_valid("load_image", load_image)
+        self.assert_eq("sum(load_image - image)", 0, sum(abs(load_image - image)))
+    }
+
+    void test_create_fill_value(Object self)
+    {
+        TagGroup size = NewTagList()
+        size.TagGroupInsertTagAsLong(infinity(), 10)
+        size.TagGroupInsertTagAsLong(infinity(), 20)
+
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsNumber("FillValue", 42)
+        options.TagGroupSetTagAsString("AllocTime", "Late")
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", 2, size, options))
+
+        Image load := h5_read_dataset(_tmp_file, "data")
+        self.assert_valid("load", load)
+        self.assert_eq("sum(abs(load - 42))", 0, sum(abs(load - 42)))
+
+        options.TagGroupSetTagAsString("AllocTime", "Sometime")
+        self.assert_false("create invalid", h5_create_dataset(_tmp_file, "data2", 2, size, options))
+    }
+
+    void test_create_sparse(Object self)
+    {
+        // 4 GB placeholder, only one chunk is ever written
+        TagGroup size = NewTagList()
+        size.TagGroupInsertTagAsLong(infinity(), 1024)
+        size.TagGroupInsertTagAsLong(infinity(), 1024)
+        size.TagGroupInsertTagAsLong(infinity(), 1024)
+
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsBoolean("Sparse", 1)
+        options.TagGroupSetTagAsNumber("FillValue", 7)
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", 2, size, options))
+        TagGroup storage_options = NewTagGroup()
+        storage_options.TagGroupSetTagAsBoolean("Storage", 1)
+        self.assert_tag_eq("info", h5_info(_tmp_file, "data", storage_options), "StorageSize", 0)
+
+        TagGroup offset = NewTagList()
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 5)
+        Image tile := RealImage("tile", 4, 16, 16)
+        tile = icol + irow
+        self.assert_true("write tile", h5_write_dataset_slice(_tmp_file, "data", offset, tile))
+
+        Image load := h5_read_dataset_slice2(_tmp_file, "data", offset, 0, 16, 1, 1, 16, 1)
+        self.assert_eq("tile", 0, sum(abs(load - tile)))
+        offset.TagGroupSetIndexedTagAsLong(2, 6)
+        load := h5_read_dataset_slice2(_tmp_file, "data", offset, 0, 16, 1, 1, 16, 1)
+        self.assert_eq("unwritten", 0, sum(abs(load - 7)))
+
+        options = NewTagGroup()
+        options.TagGroupSetTagAsString("AllocTime", "Late")
+        options.TagGroupSetTagAsString("FillTime", "Never")
+        self.assert_true("create contiguous", h5_create_dataset(_tmp_file, "data2", 2, size, options))
+
+        options.TagGroupSetTagAsString("FillTime", "Sometimes")
+        self.assert_false("create invalid", h5_create_dataset(_tmp_file, "data3", 2, size, options))
+    }
+    
     Test_H5_DataSet(Object self)
     {
         self.register_test("test_read_scalar")
@@ -197,6 +656,19 @@ class Test_H5_DataSet: TestCase
         self.register_test("test_packed")
         self.register_test("test_unsupported")
         self.register_test("test_overwrite")
+        self.register_test("test_direct_read")
+        self.register_test("test_create_options")
+        self.register_test("test_chunk_bytes")
+        self.register_test("test_create_parallel")
+        self.register_test("test_read_parallel")
+        self.register_test("test_read_into")
+        self.register_test("test_read_binned")
+        self.register_test("test_reduce")
+        self.register_test("test_append")
+        self.register_test("test_write_slice")
+        self.register_test("test_async_write")
+        self.register_test("test_create_sparse")
+        self.register_test("test_create_fill_value")
     }
 }
 
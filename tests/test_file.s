@@ -0,0 +1,267 @@
+// NOTE
+//  * You must have unittest.s installed as a script library within DM
+//  * The current directory must contain the test data:
+//    Import script to DM and immediately execute it
+//  * _tmp_dir must contain to a tmp directory (user must have write permission)
+
+     
+class Test_H5_File: TestCase
+{
+    string _tmp_dir, _tmp_file
+    string _cur_dir, _file_path
+    
+    void setup(Object self)
+    {
+        _cur_dir = GetApplicationDirectory(0, 0);
+        _file_path = PathConcatenate(_cur_dir, "test2.hdf5");
+
+        // Contrary to the documentation 6 (instead of 3) gives temporary directory
+        _tmp_dir = GetApplicationDirectory(6, 1)
+        
+        // Create temporary filename
+        while (_tmp_file == Null || DoesFileExist(_tmp_file)) {
+            string file = Hex(GetHighResTickCount(), 16) + "_" + Hex(random() * 1e8, 8) + ".hdf5"
+            _tmp_file = PathConcatenate(_tmp_dir, file);
+        }
+
+        h5_close_all()
+    }
+    
+    void teardown(Object self)
+    {
+        // Delete temporary file
+        h5_close_all()
+        DeleteFile(_tmp_file)
+    }
+
+    void test_not_a_file(Object self)
+    {
+        string not_a_file = PathConcatenate(_cur_dir, "not_a_hdf5_file.txt")
+        self.assert_false("open", h5_open(not_a_file))
+        self.assert_false("close", h5_close(not_a_file))
+    }
+
+    void test_open_close(Object self)
+    {
+        self.assert_true("open", h5_open(_file_path))
+        self.assert_true("exists", h5_exists(_file_path, "/scalar"))
+        self.assert_true("close", h5_close(_file_path))
+        self.assert_false("close again", h5_close(_file_path))
+    }
+
+    void test_open_writable(Object self)
+    {
+        self.assert_true("open", h5_open(_tmp_file, 1))
+        self.assert_true("file exists", DoesFileExist(_tmp_file))
+
+        Image data := RealImage("foo", 4, 10, 20)
+        data = icol + 10 * irow
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data))
+        self.assert_true("flush", h5_flush(_tmp_file))
+
+        Image load := h5_read_dataset(_tmp_file, "data")
+        self.assert_valid("load", load)
+        self.assert_eq("sum(load - data)", 0, sum(load - data))
+
+        self.assert_true("close", h5_close(_tmp_file))
+        self.assert_false("flush closed", h5_flush(_tmp_file))
+    }
+
+    void test_stats(Object self)
+    {
+        TagGroup stats = h5_file_cache_stats()
+        number hits, misses
+        stats.TagGroupGetTagAsNumber("Hits", hits)
+        stats.TagGroupGetTagAsNumber("Misses", misses)
+        self.assert_tag_eq("stats", stats, "Capacity", 0)
+        self.assert_tag_eq("stats", stats, "Open", 0)
+
+        // Without the cache each call opens the file
+        self.assert_true("exists", h5_exists(_file_path, "/scalar"))
+        stats = h5_file_cache_stats()
+        self.assert_tag_eq("stats", stats, "Open", 0)
+        self.assert_tag_eq("stats", stats, "Misses", misses + 1)
+        misses++
+
+        h5_set_file_cache_size(8)
+
+        self.assert_true("exists", h5_exists(_file_path, "/scalar"))
+        self.assert_true("exists", h5_exists(_file_path, "/scalar"))
+        self.assert_true("exists", h5_exists(_file_path, "/scalar"))
+
+        stats = h5_file_cache_stats()
+        self.assert_tag_eq("stats", stats, "Open", 1)
+        self.assert_tag_eq("stats", stats, "Misses", misses + 1)
+        self.assert_tag_eq("stats", stats, "Hits", hits + 2)
+        h5_set_file_cache_size(0)
+    }
+
+    void test_eviction(Object self)
+    {
+        TagGroup stats = h5_file_cache_stats()
+        number capacity, evictions
+        stats.TagGroupGetTagAsNumber("Capacity", capacity)
+        stats.TagGroupGetTagAsNumber("Evictions", evictions)
+
+        h5_set_file_cache_size(1)
+        self.assert_true("exists1", h5_exists(_file_path, "/scalar"))
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", RealImage("foo", 4, 10)))
+
+        stats = h5_file_cache_stats()
+        self.assert_tag_eq("stats", stats, "Open", 1)
+        self.assert_tag_eq("stats", stats, "Evictions", evictions + 1)
+
+        h5_set_file_cache_size(capacity)
+    }
+    
+    void test_cache_config(Object self)
+    {
+        TagGroup old_config = h5_get_cache_config()
+        self.assert_valid("old_config", old_config)
+
+        TagGroup config = NewTagGroup()
+        config.TagGroupSetTagAsNumber("ChunkCacheBytes", 32 * 1024 * 1024)
+        config.TagGroupSetTagAsNumber("ChunkCacheSlots", 12421)
+        config.TagGroupSetTagAsBoolean("AutoChunkCache", 1)
+        self.assert_true("set", h5_set_cache_config(config))
+
+        TagGroup new_config = h5_get_cache_config()
+        self.assert_tag_eq("new_config", new_config, "ChunkCacheBytes", 32 * 1024 * 1024)
+        self.assert_tag_eq("new_config", new_config, "ChunkCacheSlots", 12421)
+        self.assert_tag_eq("new_config", new_config, "ChunkCachePreemption", 0.75)
+
+        config = NewTagGroup()
+        config.TagGroupSetTagAsNumber("ChunkCachePreemption", 2)
+        self.assert_false("set invalid", h5_set_cache_config(config))
+
+        Image data := h5_read_dataset(_file_path, "scalar")
+        self.assert_valid("data", data)
+
+        self.assert_true("restore", h5_set_cache_config(old_config))
+    }
+
+    void test_decoded_cache(Object self)
+    {
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsNumber("Deflate", 4)
+        Image data := RealImage("data", 4, 64, 32, 8)
+        data = icol + irow * 64 + iplane * 10000
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data, options))
+
+        TagGroup offset = NewTagList()
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 3)
+        Image frame := h5_read_dataset_slice2(_tmp_file, "data", offset, 0, 64, 1, 1, 32, 1)
+        self.assert_valid("frame", frame)
+
+        TagGroup stats = h5_file_cache_stats()
+        number hits
+        stats.TagGroupGetTagAsNumber("DecodedCacheHits", hits)
+
+        frame := h5_read_dataset_slice2(_tmp_file, "data", offset, 0, 64, 1, 1, 32, 1)
+        self.assert_eq("frame", 0, sum(abs(frame - data[0, 0, 3, 64, 32, 4])))
+        stats = h5_file_cache_stats()
+        self.assert_tag_eq("stats", stats, "DecodedCacheHits", hits + 1)
+
+        // Writing drops the cached chunks
+        Image tile := RealImage("tile", 4, 64, 32)
+        tile = -1
+        self.assert_true("write", h5_write_dataset_slice(_tmp_file, "data", offset, tile))
+        frame := h5_read_dataset_slice2(_tmp_file, "data", offset, 0, 64, 1, 1, 32, 1)
+        self.assert_eq("written frame", 0, sum(abs(frame - tile)))
+    }
+
+    // Reads frames first to last - 1 of dataset location and waits for the readahead after each frame
+    void read_frames(Object self, string location, Image data, number first, number last)
+    {
+        TagGroup offset = NewTagList()
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        number n
+        for (n = first; n < last; n++) {
+            offset.TagGroupSetIndexedTagAsLong(2, n)
+            Image frame := h5_read_dataset_slice2(_tmp_file, location, offset, 0, 64, 1, 1, 32, 1)
+            self.assert_eq("frame", 0, sum(abs(frame - data[0, 0, n, 64, 32, n + 1])))
+            self.assert_true("wait", h5_wait())
+        }
+    }
+
+    number get_stat(Object self, string key)
+    {
+        TagGroup stats = h5_file_cache_stats()
+        number value
+        stats.TagGroupGetTagAsNumber(key, value)
+        return value
+    }
+
+    void test_readahead(Object self)
+    {
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsNumber("Deflate", 4)
+        Image data := RealImage("data", 4, 64, 32, 10)
+        data = icol + irow * 64 + iplane * 10000
+        self.assert_true("create", h5_create_dataset(_tmp_file, "off", data, options))
+        self.assert_true("create", h5_create_dataset(_tmp_file, "on", data, options))
+
+        h5_set_readahead(0)
+        number chunks = self.get_stat("ReadaheadChunks")
+        number hits = self.get_stat("DecodedCacheHits")
+        self.read_frames("off", data, 0, 10)
+        self.assert_eq("readahead off", chunks, self.get_stat("ReadaheadChunks"))
+        number hits_off = self.get_stat("DecodedCacheHits") - hits
+
+        h5_set_readahead(4)
+        chunks = self.get_stat("ReadaheadChunks")
+        hits = self.get_stat("DecodedCacheHits")
+        self.read_frames("on", data, 0, 10)
+        self.assert_true("readahead on", self.get_stat("ReadaheadChunks") > chunks)
+        self.assert_true("hits", self.get_stat("DecodedCacheHits") - hits > hits_off)
+    }
+
+    void test_readahead_after_close(Object self)
+    {
+        TagGroup options = NewTagGroup()
+        options.TagGroupSetTagAsNumber("Deflate", 4)
+        Image data := RealImage("data", 4, 64, 32, 20)
+        data = icol + irow * 64 + iplane * 10000
+        self.assert_true("create", h5_create_dataset(_tmp_file, "data", data, options))
+
+        h5_set_readahead(4)
+        self.read_frames("data", data, 0, 4)
+
+        // Closing the file cancels the readahead started by this frame
+        TagGroup offset = NewTagList()
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 0)
+        offset.TagGroupInsertTagAsLong(infinity(), 4)
+        Image frame := h5_read_dataset_slice2(_tmp_file, "data", offset, 0, 64, 1, 1, 32, 1)
+        h5_close(_tmp_file)
+
+        number chunks = self.get_stat("ReadaheadChunks")
+        number hits = self.get_stat("DecodedCacheHits")
+        self.read_frames("data", data, 5, 20)
+        self.assert_true("readahead", self.get_stat("ReadaheadChunks") > chunks)
+        self.assert_true("hits", self.get_stat("DecodedCacheHits") > hits)
+    }
+
+    Test_H5_File(Object self)
+    {
+        self.register_test("test_not_a_file")
+        self.register_test("test_open_close")
+        self.register_test("test_open_writable")
+        self.register_test("test_stats")
+        self.register_test("test_eviction")
+        self.register_test("test_cache_config")
+        self.register_test("test_decoded_cache")
+        self.register_test("test_readahead")
+        self.register_test("test_readahead_after_close")
+    }
+}
+
+{
+    Object runner = alloc(TestRunner)
+    runner.register_test_case(alloc(Test_H5_File))
+    runner.start()
+}
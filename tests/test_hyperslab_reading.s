@@ -207,6 +207,108 @@ class Test_H5_Hyperslab_Reading: TestCase
         self.assert_not_valid("invalid offsets (type)", data)
     }
 
+    TagGroup long_list(Object self, number a, number b, number c, number d)
+    {
+        TagGroup list = NewTagList()
+        list.TagGroupInsertTagAsLong(infinity(), a)
+        list.TagGroupInsertTagAsLong(infinity(), b)
+        if (c >= 0)
+            list.TagGroupInsertTagAsLong(infinity(), c)
+        if (d >= 0)
+            list.TagGroupInsertTagAsLong(infinity(), d)
+        return list
+    }
+
+    void test_read_slice(Object self)
+    {
+        TagGroup offsets = self.long_list(0, 0, 0, 0)
+        TagGroup dims = self.long_list(0, 1, 2, 3)
+        TagGroup counts = self.long_list(16, 4, 2, 3)
+        TagGroup strides = self.long_list(1, 4, 8, 5)
+        
+        // Every 4th row, 8th plane and 5th volume
+        Image data := h5_read_dataset_slice(_file_path, "data", offsets, dims, counts, strides)
+        self.assert_valid("data", data)
+        self.assert_eq("data.ndim", ImageGetNumDimensions(data), 4)
+        self.assert_eq("data.dim[0]", ImageGetDimensionSize(data, 0), 16)
+        self.assert_eq("data.dim[1]", ImageGetDimensionSize(data, 1), 4)
+        self.assert_eq("data.dim[2]", ImageGetDimensionSize(data, 2), 2)
+        self.assert_eq("data.dim[3]", ImageGetDimensionSize(data, 3), 3)
+        self.assert_eq("sum(data)", sum(data), 120 * 24 + 16 * 24 * 96 + 256 * 8 * 192 + 4096 * 15 * 128)
+    }
+
+    void test_read_slice_blocks(Object self)
+    {
+        TagGroup offsets = self.long_list(1, 2, 0, 0)
+        TagGroup dims = self.long_list(0, 1, -1, -1)
+        TagGroup counts = self.long_list(2, 3, -1, -1)
+        TagGroup strides = self.long_list(8, 4, -1, -1)
+        TagGroup blocks = self.long_list(2, 2, -1, -1)
+        
+        // Blocks of 2 x 2 elements
+        Image data := h5_read_dataset_slice(_file_path, "data", offsets, dims, counts, strides, blocks)
+        self.assert_valid("data", data)
+        self.assert_eq("data.ndim", ImageGetNumDimensions(data), 2)
+        self.assert_eq("data.dim[0]", ImageGetDimensionSize(data, 0), 4)
+        self.assert_eq("data.dim[1]", ImageGetDimensionSize(data, 1), 6)
+        self.assert_eq("data[0, 0]", data.GetPixel(0, 0), 1 + 2 * 16)
+        self.assert_eq("data[1, 0]", data.GetPixel(1, 0), 2 + 2 * 16)
+        self.assert_eq("data[2, 0]", data.GetPixel(2, 0), 9 + 2 * 16)
+        self.assert_eq("data[3, 1]", data.GetPixel(3, 1), 10 + 3 * 16)
+        self.assert_eq("data[0, 2]", data.GetPixel(0, 2), 1 + 6 * 16)
+    }
+
+    void test_read_slice_error(Object self)
+    {
+        TagGroup offsets = self.long_list(0, 0, 0, 0)
+        TagGroup dims = self.long_list(0, 1, -1, -1)
+        TagGroup strides = self.long_list(1, 1, -1, -1)
+
+        // Size of lists differs
+        Image data := h5_read_dataset_slice(_file_path, "data", offsets, dims, self.long_list(4, 4, 4, -1), strides)
+        self.assert_not_valid("invalid counts (size)", data)
+
+        // Invalid dimension order
+        data := h5_read_dataset_slice(_file_path, "data", offsets, self.long_list(1, 0, -1, -1), self.long_list(4, 4, -1, -1), strides)
+        self.assert_not_valid("invalid dimension order", data)
+
+        // Overlapping blocks
+        data := h5_read_dataset_slice(_file_path, "data", offsets, dims, self.long_list(4, 4, -1, -1), strides, self.long_list(2, 1, -1, -1))
+        self.assert_not_valid("overlapping blocks", data)
+    }
+
+    void test_read_points(Object self)
+    {
+        // 4 x 3 points with 4 coordinates each
+        Image coords := IntegerImage("coords", 2, 1, 4, 4, 3)
+        coords = (icol == 0) * irow + (icol == 1) * 2 * iplane + (icol == 3) * (15 - irow)
+        
+        Image data := h5_read_dataset_points(_file_path, "data", coords)
+        self.assert_valid("data", data)
+        self.assert_eq("data.ndim", ImageGetNumDimensions(data), 2)
+        self.assert_eq("data.dim[0]", ImageGetDimensionSize(data, 0), 4)
+        self.assert_eq("data.dim[1]", ImageGetDimensionSize(data, 1), 3)
+        self.assert_eq("data[]", sum(abs(data - icol - 2 * irow * 16 - (15 - icol) * 4096)), 0)
+    }
+
+    void test_read_points_list(Object self)
+    {
+        TagGroup points = NewTagList()
+        points.TagGroupInsertTagAsTagGroup(infinity(), self.long_list(1, 2, 3, 4))
+        points.TagGroupInsertTagAsTagGroup(infinity(), self.long_list(15, 0, 0, 0))
+        
+        Image data := h5_read_dataset_points(_file_path, "data", points)
+        self.assert_valid("data", data)
+        self.assert_eq("data.ndim", ImageGetNumDimensions(data), 1)
+        self.assert_eq("data[0]", data.GetPixel(0, 0), 1 + 2 * 16 + 3 * 256 + 4 * 4096)
+        self.assert_eq("data[1]", data.GetPixel(1, 0), 15)
+
+        // Point outside of dataset
+        points.TagGroupInsertTagAsTagGroup(infinity(), self.long_list(16, 0, 0, 0))
+        data := h5_read_dataset_points(_file_path, "data", points)
+        self.assert_not_valid("outside", data)
+    }
+
     Test_H5_Hyperslab_Reading(Object self)
     {
         self.register_test("test_read_slice1")
@@ -220,6 +322,12 @@ class Test_H5_Hyperslab_Reading: TestCase
         self.register_test("test_read_slice2_dimension")
         self.register_test("test_read_slice2_slice")
         self.register_test("test_read_slice2_error")
+
+        self.register_test("test_read_slice")
+        self.register_test("test_read_slice_blocks")
+        self.register_test("test_read_slice_error")
+        self.register_test("test_read_points")
+        self.register_test("test_read_points_list")
     }
 }
 
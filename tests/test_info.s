@@ -141,6 +141,131 @@ class Test_H5_Info: TestCase
         self.assert_false("cdata.Size", TagGroupGetTagAsTagGroup(info, "Size", size))
     }
     
+    void test_options(Object self)
+    {
+        taggroup options = NewTagGroup()
+        options.TagGroupSetTagAsLong("MaxDepth", 1)
+        taggroup info = h5_info(_file_path, "/", options)
+        self.assert_valid("depth", info)
+        self.assert_tag_count("depth", info, "Contents", 7)
+
+        taggroup group
+        self.assert_true("depth.group", TagGroupGetTagAsTagGroup(info, "Contents[3]", group))
+        self.assert_tag_eq("depth.group", group, "Name", "/group")
+        taggroup contents
+        self.assert_false("depth.group.Contents", TagGroupGetTagAsTagGroup(group, "Contents", contents))
+
+        options = NewTagGroup()
+        options.TagGroupSetTagAsString("Types", "DataSet")
+        options.TagGroupSetTagAsBoolean("Details", 0)
+        info = h5_info(_file_path, "/", options)
+        self.assert_valid("types", info)
+        self.assert_tag_count("types", info, "Contents", 6)
+
+        taggroup data
+        self.assert_true("types.data", TagGroupGetTagAsTagGroup(info, "Contents[2]", data))
+        self.assert_tag_eq("types.data", data, "Name", "/data")
+        self.assert_tag_eq("types.data", data, "Type", "DataSet")
+        number dtype
+        self.assert_false("types.data.DataType", TagGroupGetTagAsLong(data, "DataType", dtype))
+        self.assert_tag_count("types.group", info, "Contents[3]:Contents", 1)
+
+        options = NewTagGroup()
+        options.TagGroupSetTagAsLong("Start", 2)
+        options.TagGroupSetTagAsLong("Count", 3)
+        info = h5_info(_file_path, "/", options)
+        self.assert_valid("paged", info)
+        self.assert_tag_eq("paged", info, "NumMembers", 7)
+        self.assert_tag_count("paged", info, "Contents", 3)
+        self.assert_tag_eq("paged", info, "Contents[0]:Name", "/data")
+        self.assert_tag_eq("paged", info, "Contents[2]:Name", "/hard")
+
+        options.TagGroupSetTagAsString("Types", "Folder")
+        self.assert_false("invalid", TagGroupIsValid(h5_info(_file_path, "/", options)))
+    }
+
+    void test_find(Object self)
+    {
+        taggroup paths = h5_find(_file_path, "/", "*a*")
+        self.assert_valid("pattern", paths)
+        self.assert_eq("len(pattern)", 4, TagGroupCountTags(paths))
+        self.assert_tag_eq("pattern", paths, 0, "/cdata")
+        self.assert_tag_eq("pattern", paths, 3, "/scalar")
+
+        paths = h5_find(_file_path, "/", "/group/*")
+        self.assert_eq("len(path)", 1, TagGroupCountTags(paths))
+        self.assert_tag_eq("path", paths, 0, "/group/nested")
+
+        taggroup criteria = NewTagGroup()
+        criteria.TagGroupSetTagAsString("Types", "DataSet")
+        criteria.TagGroupSetTagAsLong("MinRank", 3)
+        paths = h5_find(_file_path, "/", "", criteria)
+        self.assert_eq("len(rank)", 2, TagGroupCountTags(paths))
+        self.assert_tag_eq("rank", paths, 0, "/ch")
+        self.assert_tag_eq("rank", paths, 1, "/group/nested")
+
+        criteria = NewTagGroup()
+        criteria.TagGroupSetTagAsLong("DataType", 2)
+        taggroup min_size = NewTagList()
+        min_size.TagGroupInsertTagAsLong(infinity(), 10)
+        criteria.TagGroupSetTagAsTagGroup("MinSize", min_size)
+        paths = h5_find(_file_path, "/", "*", criteria)
+        self.assert_eq("len(size)", 2, TagGroupCountTags(paths))
+        self.assert_tag_eq("size", paths, 0, "/data")
+        self.assert_tag_eq("size", paths, 1, "/hard")
+
+        criteria = NewTagGroup()
+        taggroup attributes = NewTagList()
+        attributes.TagGroupInsertTagAsString(infinity(), "int")
+        criteria.TagGroupSetTagAsTagGroup("Attributes", attributes)
+        paths = h5_find(_file_path, "/", "*", criteria)
+        self.assert_eq("len(attr)", 2, TagGroupCountTags(paths))
+
+        self.assert_false("noent", TagGroupIsValid(h5_find(_file_path, "/noent", "*")))
+    }
+
+    void test_storage(Object self)
+    {
+        taggroup options = NewTagGroup()
+        options.TagGroupSetTagAsBoolean("Storage", 1)
+        taggroup info = h5_info(_file_path, "/data", options)
+        self.assert_valid("data", info)
+        self.assert_tag_eq("data", info, "Layout", "CONTIGUOUS")
+        self.assert_tag_eq("data", info, "StorageSize", 360)
+        self.assert_tag_eq("data", info, "DataSize", 360)
+        self.assert_tag_eq("data", info, "CompressionRatio", 1)
+        self.assert_tag_count("data", info, "Filters", 0)
+
+        info = h5_info(_file_path, "/ch", options)
+        self.assert_valid("ch", info)
+        self.assert_tag_eq("ch", info, "Layout", "CHUNKED")
+        self.assert_tag_eq("ch", info, "StorageSize", 0)
+        
+        info = h5_info(_file_path, "/data")
+        string layout
+        self.assert_false("default", TagGroupGetTagAsString(info, "Layout", layout))
+    }
+
+    void test_index(Object self)
+    {
+        // Contrary to the documentation 6 (instead of 3) gives temporary directory
+        string tmp_dir = GetApplicationDirectory(6, 1)
+        self.assert_true("h5_set_info_index", h5_set_info_index(tmp_dir))
+
+        number n
+        for (n = 0; n < 2; n++) {
+            taggroup info = h5_info(_file_path)
+            self.assert_valid("index", info)
+            self.assert_tag_count("index", info, "Contents", 7)
+            self.assert_tag_eq("index", info, "Contents[2]:Name", "/data")
+            self.assert_tag_eq("index", info, "Contents[2]:DataType", 2)
+            self.assert_tag_count("index", info, "Contents[3]:Contents", 1)
+        }
+
+        self.assert_false("nonexistent", h5_set_info_index(PathConcatenate(tmp_dir, "nonexistent")))
+        self.assert_true("disable", h5_set_info_index(""))
+    }
+
     void test_noent(Object self)
     {
         taggroup info = h5_info(_file_path, "/noent")
@@ -169,6 +294,10 @@ class Test_H5_Info: TestCase
         self.register_test("test_group")
         self.register_test("test_soft")
         self.register_test("test_scalar")
+        self.register_test("test_options")
+        self.register_test("test_find")
+        self.register_test("test_storage")
+        self.register_test("test_index")
         self.register_test("test_noent")
         self.register_test("test_existance")
     }
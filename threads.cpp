@@ -0,0 +1,134 @@
+#include "threads.h"
+#include <process.h>
+#include <algorithm>
+
+worker_pool_t::worker_pool_t(unsigned num_threads)
+: work_event(true), quit(false)
+{
+    if (num_threads == 0) {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        num_threads = info.dwNumberOfProcessors > 0 ? unsigned(info.dwNumberOfProcessors) : 1;
+    }
+
+    for (unsigned n = 0; n < num_threads; ++n) {
+        HANDLE thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL, 0, &thread_main, this, 0, NULL));
+        if (!thread)
+            break;
+        threads.push_back(thread);
+    }
+}
+
+worker_pool_t::~worker_pool_t()
+{
+    mutex.lock();
+    quit = true;
+    work_event.set();
+    mutex.unlock();
+
+    for (std::vector<HANDLE>::const_iterator iter = threads.begin(); iter != threads.end(); ++iter) {
+        WaitForSingleObject(*iter, INFINITE);
+        CloseHandle(*iter);
+    }
+}
+
+unsigned __stdcall worker_pool_t::thread_main(void* param)
+{
+    static_cast<worker_pool_t*>(param)->work();
+    return 0;
+}
+
+/**
+ * Takes the next index to process. Must be called with the mutex locked.
+ * @param only Job to take the index from, NULL for the oldest job.
+ * @returns Job of index, NULL if there is none.
+ */
+worker_pool_t::job_t* worker_pool_t::next_index(job_t* only, std::size_t& index)
+{
+    std::vector<job_t*>::iterator iter = only ? std::find(jobs.begin(), jobs.end(), only) : jobs.begin();
+    if (iter == jobs.end())
+        return NULL;
+
+    job_t* job = *iter;
+    index = job->next_index++;
+    if (job->next_index >= job->count) {
+        jobs.erase(iter);
+        if (jobs.empty())
+            work_event.reset();
+    }
+    return job;
+}
+
+void worker_pool_t::process(job_t& job, std::size_t index)
+{
+    bool success;
+    try {
+        success = job.task->run(index);
+    } catch (...) {
+        success = false;
+    }
+
+    scoped_lock_t lock(mutex);
+    if (!success)
+        job.failed = true;
+    if (--job.pending == 0)
+        job.done_event.set();
+}
+
+void worker_pool_t::work()
+{
+    for (;;) {
+        mutex.lock();
+        if (quit) {
+            mutex.unlock();
+            return;
+        }
+
+        std::size_t index;
+        job_t* job = next_index(NULL, index);
+        mutex.unlock();
+
+        if (job)
+            process(*job, index);
+        else
+            work_event.wait();
+    }
+}
+
+void worker_pool_t::start(job_t& job, task_t& t, std::size_t num)
+{
+    scoped_lock_t lock(mutex);
+
+    job.task = &t;
+    job.count = num;
+    job.next_index = 0;
+    job.pending = num;
+    job.failed = false;
+
+    if (num > 0) {
+        job.done_event.reset();
+        jobs.push_back(&job);
+        if (!threads.empty())
+            work_event.set();
+    } else
+        job.done_event.set();
+}
+
+bool worker_pool_t::wait(job_t& job)
+{
+    // Without threads the job is processed by the caller only
+    for (;;) {
+        std::size_t index;
+        mutex.lock();
+        job_t* next = next_index(&job, index);
+        mutex.unlock();
+        if (!next)
+            break;
+        process(job, index);
+    }
+
+    job.done_event.wait();
+
+    scoped_lock_t lock(mutex);
+    return !job.failed;
+}
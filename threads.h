@@ -0,0 +1,157 @@
+#ifndef HDF5_THREADS_INC
+#define HDF5_THREADS_INC
+
+#include <windows.h>
+#include <vector>
+
+/**
+ * A mutex based on a critical section. The mutex is recursive.
+ * No method throws an exception.
+ */
+class mutex_t
+{
+private:
+    // No copy
+    mutex_t(const mutex_t&);
+    mutex_t& operator=(const mutex_t&);
+
+    CRITICAL_SECTION cs;
+
+public:
+    mutex_t() throw () { InitializeCriticalSection(&cs); }
+    ~mutex_t() throw () { DeleteCriticalSection(&cs); }
+
+    void lock() throw () { EnterCriticalSection(&cs); }
+    void unlock() throw () { LeaveCriticalSection(&cs); }
+};
+
+/**
+ * Locks a mutex for the lifetime of this object.
+ */
+class scoped_lock_t
+{
+private:
+    // No copy
+    scoped_lock_t(const scoped_lock_t&);
+    scoped_lock_t& operator=(const scoped_lock_t&);
+
+    mutex_t& mutex;
+
+public:
+    explicit scoped_lock_t(mutex_t& m) throw () : mutex(m) { mutex.lock(); }
+    ~scoped_lock_t() throw () { mutex.unlock(); }
+};
+
+/**
+ * A Win32 event object.
+ * No method throws an exception.
+ */
+class event_t
+{
+private:
+    // No copy
+    event_t(const event_t&);
+    event_t& operator=(const event_t&);
+
+    HANDLE handle;
+
+public:
+    /** Creates event, which is initially not signaled. */
+    explicit event_t(bool manual_reset = false) throw () : handle(CreateEvent(NULL, manual_reset ? TRUE : FALSE, FALSE, NULL)) {}
+    ~event_t() throw () { if (handle) CloseHandle(handle); }
+
+    void set() throw () { SetEvent(handle); }
+    void reset() throw () { ResetEvent(handle); }
+    void wait() throw () { WaitForSingleObject(handle, INFINITE); }
+
+    /** Waits at most @p milliseconds. Returns whether event was signaled. */
+    bool wait(DWORD milliseconds) throw () { return WaitForSingleObject(handle, milliseconds) == WAIT_OBJECT_0; }
+};
+
+/**
+ * A fixed set of worker threads, which process the indices of tasks in parallel.
+ * Tasks must not call the HDF5 library, which is not thread safe. Several tasks
+ * can be processed at a time, each is tracked by a job_t of the caller.
+ */
+class worker_pool_t
+{
+public:
+    /** Work to be done by the pool. */
+    struct task_t
+    {
+        virtual ~task_t() {}
+
+        /**
+         * Processes one index. Called concurrently from the worker threads.
+         * @returns Whether succeeded.
+         */
+        virtual bool run(std::size_t index) = 0;
+    };
+
+    /** Progress of a task started by start(). Must exist until wait() returns. */
+    class job_t
+    {
+    private:
+        friend class worker_pool_t;
+
+        // No copy
+        job_t(const job_t&);
+        job_t& operator=(const job_t&);
+
+        task_t*     task;
+        std::size_t next_index;
+        std::size_t count;
+        std::size_t pending;        // Indices not finished yet
+        bool        failed;
+        event_t     done_event;     // Signaled when all indices are processed
+
+    public:
+        job_t() : task(NULL), next_index(0), count(0), pending(0), failed(false), done_event(true) { done_event.set(); }
+    };
+
+private:
+    // No copy
+    worker_pool_t(const worker_pool_t&);
+    worker_pool_t& operator=(const worker_pool_t&);
+
+    static unsigned __stdcall thread_main(void* param);
+    void work();
+    job_t* next_index(job_t* only, std::size_t& index);
+    void process(job_t& job, std::size_t index);
+
+    std::vector<HANDLE> threads;
+    mutex_t             mutex;
+    event_t             work_event;     // Signaled when new indices are available
+    std::vector<job_t*> jobs;           // Jobs with indices not started yet, oldest first
+    bool                quit;
+
+public:
+    /**
+     * Starts worker threads.
+     * @param num_threads Number of threads, 0 for number of processors.
+     */
+    explicit worker_pool_t(unsigned num_threads = 0);
+
+    /** Stops worker threads. No job may be running. */
+    ~worker_pool_t();
+
+    /** Returns number of worker threads. */
+    std::size_t size() const { return threads.size(); }
+
+    /**
+     * Starts processing of indices 0 to @p num-1 of @p t asynchronously.
+     * The task must exist until wait() returns.
+     */
+    void start(job_t& job, task_t& t, std::size_t num);
+
+    /**
+     * Waits until a job is done. The calling thread processes indices of the job meanwhile.
+     * @returns Whether all indices succeeded.
+     */
+    bool wait(job_t& job);
+
+    /** Processes task synchronously. Returns whether all indices succeeded. */
+    bool run(task_t& t, std::size_t num) { job_t job; start(job, t, num); return wait(job); }
+};
+
+#endif // HDF5_THREADS_INC
@@ -20,6 +20,10 @@ void debug(const char* fmt, ...)
     if (size < 0)
         message[sizeof(message)-1] = 0;
 
+    // DM must only be called by the script thread
+    if (defer_message(message))
+        return;
+
     char* ptr = message;
     char end;
     do {
@@ -58,6 +62,10 @@ void warning(const char* fmt, ...)
     if (size < 0)
         message[sizeof(message)-1] = 0;
 
+    // DM must only be called by the script thread
+    if (defer_message(message))
+        return;
+
     char* ptr = message;
     char end;
     do {
@@ -99,6 +107,15 @@ void dump_HDF_error_stack()
 
 #endif // ENABLE_DEBUG
 
+void free_HDF(void* ptr)
+{
+#if H5_VERSION_GE(1, 8, 13)
+    H5free_memory(ptr);
+#else
+    free(ptr);
+#endif
+}
+
 BOOST_STATIC_ASSERT(sizeof(wchar_t) == 2);       // Else replace utf16 by utf32
 
 DM::String from_UTF8(const std::string &input)
@@ -187,8 +204,8 @@ type_handle_t create_compatible_complex_type(hid_t type_id) throw()
     if ((_stricmp("r", field0) != 0 || _stricmp("i", field1) != 0) 
     &&  (_stricmp("re", field0) != 0 || _stricmp("im", field1) != 0)
     &&  (_stricmp("real", field0) != 0 || _stricmp("imag", field1) != 0)) {
-        free(field0);
-        free(field1);
+        free_HDF(field0);
+        free_HDF(field1);
         return type_handle_t();
     }
 
@@ -198,8 +215,8 @@ type_handle_t create_compatible_complex_type(hid_t type_id) throw()
     else
         memtype = create_complex_type(16, field0, field1);
 
-    free(field0);
-    free(field1);
+    free_HDF(field0);
+    free_HDF(field1);
     return memtype;
 }
 
@@ -289,8 +306,8 @@ long datatype_from_HDF(hid_t type_id)
             bool real_and_imag = (_stricmp("r", field0) == 0 && _stricmp("i", field1) == 0) 
                               || (_stricmp("re", field0) == 0 && _stricmp("im", field1) == 0)
                               || (_stricmp("real", field0) == 0 && _stricmp("imag", field1) == 0);
-            free(field0);
-            free(field1);
+            free_HDF(field0);
+            free_HDF(field1);
             if (!real_and_imag)
                 return -1;
         }
@@ -344,7 +361,7 @@ DM::Image create_image(long datatype, int rank, const hsize_t* dims)
     }
 }
 
-int hsize_array_from_HDF5(int space_id, std::vector<hsize_t>& dims)
+int hsize_array_from_HDF5(hid_t space_id, std::vector<hsize_t>& dims)
 {
     dims.clear();
 
@@ -393,12 +410,3 @@ std::vector<hsize_t> hsize_array_from_taglist(const Gatan::DM::TagGroup &list)
 
     return result;
 }
-
-file_handle_t open_always(const char* filename)
-{
-    file_handle_t file(H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT));
-    if (!file.valid())
-        file.reset(H5Fcreate(filename, H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT));
-
-    return file;
-}
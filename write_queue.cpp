@@ -0,0 +1,257 @@
+#include "plugin.h"
+#include "threads.h"
+#include <process.h>
+#include <deque>
+#include <algorithm>
+
+using namespace Gatan;
+
+// Queued data is limited, further writes wait for the queue to drain. 32 bit processes
+// can't hold much more besides DM's own images.
+static const std::size_t max_queued_bytes = (sizeof(void*) > 4 ? 1024 : 256) * 1024 * 1024;
+
+// Serializes calls of the HDF5 library
+static mutex_t library_mutex;
+
+static bool async_enabled = false;
+
+// Queue state, guarded by queue_mutex
+static mutex_t                   queue_mutex;
+static std::deque<write_job_t*>  queue;
+static write_job_t*              running_job = NULL;
+static std::size_t               queued_bytes = 0;
+static unsigned long             failed_jobs = 0;       // Since last h5_wait()
+static std::vector<std::string>  deferred_messages;     // Messages of background threads
+static std::vector<DWORD>        background_threads;    // Threads, whose messages are deferred
+static HANDLE                    write_thread = NULL;
+static bool                      quit = false;
+static event_t                   work_event;            // Signaled when jobs are queued
+static event_t                   changed_event(true);   // Signaled when a job finished
+
+static unsigned __stdcall write_thread_main(void*)
+{
+    register_background_thread(true);
+    for (;;) {
+        write_job_t* job = NULL;
+        {
+            scoped_lock_t lock(queue_mutex);
+            if (!queue.empty()) {
+                job = queue.front();
+                queue.pop_front();
+                running_job = job;
+            } else if (quit) {
+                register_background_thread(false);
+                return 0;
+            }
+        }
+
+        if (!job) {
+            work_event.wait();
+            continue;
+        }
+
+        bool success;
+        {
+            scoped_lock_t lock(library_mutex);
+            try {
+                success = job->run();
+            } catch (...) {
+                success = false;
+            }
+            if (!success)
+                warning("Asynchronous write of '%s' to '%s' failed.", job->location.c_str(), job->filename.c_str());
+        }
+
+        scoped_lock_t lock(queue_mutex);
+        if (!success)
+            ++failed_jobs;
+        queued_bytes -= job->size;
+        running_job = NULL;
+        delete job;
+        changed_event.set();
+    }
+}
+
+// Returns whether a job for path (all jobs for empty path) is queued or running.
+static bool is_pending(const std::string& path)
+{
+    if (running_job && (path.empty() || _stricmp(running_job->path.c_str(), path.c_str()) == 0))
+        return true;
+
+    for (std::deque<write_job_t*>::const_iterator iter = queue.begin(); iter != queue.end(); ++iter)
+        if (path.empty() || _stricmp((*iter)->path.c_str(), path.c_str()) == 0)
+            return true;
+
+    return false;
+}
+
+// Waits until no job for path (all jobs for empty path) is pending.
+static void wait_pending(const std::string& path)
+{
+    for (;;) {
+        {
+            scoped_lock_t lock(queue_mutex);
+            changed_event.reset();
+            if (!is_pending(path))
+                return;
+        }
+
+        // Timeout in case another waiter reset the event
+        changed_event.wait(100);
+    }
+}
+
+// Reports messages of the write thread on the calling thread.
+static void report_deferred_messages()
+{
+    std::vector<std::string> messages;
+    {
+        scoped_lock_t lock(queue_mutex);
+        messages.swap(deferred_messages);
+    }
+
+    for (std::vector<std::string>::const_iterator iter = messages.begin(); iter != messages.end(); ++iter)
+        warning("%s", iter->c_str());
+}
+
+write_job_t::write_job_t(const char* _filename, const std::string& _location)
+: filename(_filename), path(normalize_path(_filename)), location(_location), size(0)
+{
+}
+
+bool async_writes_enabled()
+{
+    return async_enabled;
+}
+
+void queue_write(write_job_t* job)
+{
+    // Wait for space in queue, but always accept a job into an empty queue
+    for (;;) {
+        {
+            scoped_lock_t lock(queue_mutex);
+            changed_event.reset();
+            if (!is_pending(std::string()) || queued_bytes + job->size <= max_queued_bytes)
+                break;
+        }
+        changed_event.wait(100);
+    }
+
+    scoped_lock_t lock(queue_mutex);
+    if (!write_thread) {
+        quit = false;
+        write_thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL, 0, &write_thread_main, NULL, 0, NULL));
+        if (!write_thread) {
+            // Without thread, write synchronously
+            scoped_lock_t library_lock(library_mutex);
+            if (!job->run())
+                ++failed_jobs;
+            delete job;
+            return;
+        }
+    }
+
+    queue.push_back(job);
+    queued_bytes += job->size;
+    work_event.set();
+}
+
+void register_background_thread(bool enable)
+{
+    scoped_lock_t lock(queue_mutex);
+    std::vector<DWORD>::iterator iter = std::find(background_threads.begin(), background_threads.end(), GetCurrentThreadId());
+    if (enable && iter == background_threads.end())
+        background_threads.push_back(GetCurrentThreadId());
+    else if (!enable && iter != background_threads.end())
+        background_threads.erase(iter);
+}
+
+bool defer_message(const char* message)
+{
+    scoped_lock_t lock(queue_mutex);
+    if (std::find(background_threads.begin(), background_threads.end(), GetCurrentThreadId()) == background_threads.end())
+        return false;
+
+    deferred_messages.push_back(message);
+    return true;
+}
+
+void wait_write_queue()
+{
+    wait_pending(std::string());
+}
+
+void stop_write_queue()
+{
+    wait_pending(std::string());
+
+    HANDLE thread = NULL;
+    {
+        scoped_lock_t lock(queue_mutex);
+        quit = true;
+        thread = write_thread;
+        write_thread = NULL;
+        work_event.set();
+    }
+
+    if (thread) {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+    }
+    report_deferred_messages();
+}
+
+library_lock_t::library_lock_t(const char* filename)
+{
+    // Reading or writing a file sees all data queued before
+    if (filename)
+        wait_pending(normalize_path(filename));
+
+    library_mutex.lock();
+    report_deferred_messages();
+}
+
+library_lock_t::~library_lock_t()
+{
+    library_mutex.unlock();
+}
+
+void h5_set_async_write(bool enable)
+{
+    async_enabled = enable;
+}
+
+bool h5_wait()
+{
+    bool success = true;
+
+    PLUG_IN_ENTRY
+
+        wait_write_queue();
+        wait_readahead();
+        report_deferred_messages();
+
+        scoped_lock_t lock(queue_mutex);
+        success = failed_jobs == 0;
+        failed_jobs = 0;
+
+    PLUG_IN_EXIT
+
+    return success;
+}
+
+long h5_pending()
+{
+    long count = 0;
+
+    PLUG_IN_ENTRY
+
+        report_deferred_messages();
+
+        scoped_lock_t lock(queue_mutex);
+        count = long(queue.size()) + (running_job ? 1 : 0);
+
+    PLUG_IN_EXIT
+
+    return count;
+}